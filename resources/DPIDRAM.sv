@@ -1,7 +1,19 @@
 
 module DPIDRAM #(
     parameter FILENAME = "test.hex",
-    parameter MEM_SIZE = 16777216 // 16MB
+    parameter MEM_SIZE = 16777216, // 16MB
+
+    // Timing model, each can be overridden at runtime by +dram_<name>=<value>
+    parameter N_BANKS = 8,
+    parameter ROW_BYTES = 2048,
+    parameter T_CAS = 10,
+    parameter T_RCD = 10,
+    parameter T_RP = 10,
+    parameter BUS_BYTES = 8,
+    parameter OPEN_PAGE = 1,
+
+    // dram.log verbosity: 0 off, 1 info, 2 per-request trace (+dram_log=<n>)
+    parameter LOG_LEVEL = 1
 )(
     input  logic         clock,
     input  logic         reset,
@@ -17,11 +29,42 @@ module DPIDRAM #(
     input  logic         resp_ready,
     output logic         resp_valid,
     output logic [3:0]   resp_bits_id,
-    output logic [127:0] resp_bits_data
+    output logic [127:0] resp_bits_data,
+
+    input  logic         ckpt_valid,
+    input  logic [31:0]  ckpt_bits_pc,
+    input  logic [1023:0] ckpt_bits_regs,
+
+    output logic [31:0]  boot_pc,
+    output logic [1023:0] boot_regs
 );
 
+    import "DPI-C" context function void dram_config(
+        input int          n_banks,
+        input int          row_bytes,
+        input int          t_cas,
+        input int          t_rcd,
+        input int          t_rp,
+        input int          bus_bytes,
+        input logic        open_page
+    );
     import "DPI-C" context function void dram_init(input string hex_file);
+    import "DPI-C" context function void dram_log_level(input int level);
+    import "DPI-C" context function void dram_stats_path(input string path);
+    import "DPI-C" context function void dram_finish(input longint cycle);
+    // Statistic by name (see docs/dram.md), -1 if unknown
+    import "DPI-C" context function longint dram_stat(input string name);
+    import "DPI-C" context function void dram_checkpoint(
+        input string       path,
+        input int          pc,
+        input bit [1023:0] regs
+    );
+    import "DPI-C" context function void dram_boot_state(
+        output int          pc,
+        output bit [1023:0] regs
+    );
     import "DPI-C" context function void dram_tick(
+        input  longint      cycle,
         input  logic        req_valid,
         input  int          req_id,
         input  longint      req_addr,
@@ -33,11 +76,65 @@ module DPIDRAM #(
         output logic        req_ready,
         output logic        resp_valid,
         output int          resp_id,
-        output bit [127:0]  resp_data
+        output bit [127:0]  resp_data,
+        output int          pending,
+        output longint      next_ready
     );
 
+    int cfg_n_banks   = N_BANKS;
+    int cfg_row_bytes = ROW_BYTES;
+    int cfg_t_cas     = T_CAS;
+    int cfg_t_rcd     = T_RCD;
+    int cfg_t_rp      = T_RP;
+    int cfg_bus_bytes = BUS_BYTES;
+    int cfg_open_page = OPEN_PAGE;
+    int cfg_log_level = LOG_LEVEL;
+    string ckpt_path  = ""; // Empty: <FILENAME>.ckpt
+    string stats_path = ""; // Empty: dram_stats.json
+
+    int          boot_pc_val;
+    bit [1023:0] boot_regs_val;
+    assign boot_pc   = boot_pc_val;
+    assign boot_regs = boot_regs_val;
+
     initial begin
+        void'($value$plusargs("dram_banks=%d", cfg_n_banks));
+        void'($value$plusargs("dram_row_bytes=%d", cfg_row_bytes));
+        void'($value$plusargs("dram_tcas=%d", cfg_t_cas));
+        void'($value$plusargs("dram_trcd=%d", cfg_t_rcd));
+        void'($value$plusargs("dram_trp=%d", cfg_t_rp));
+        void'($value$plusargs("dram_bus_bytes=%d", cfg_bus_bytes));
+        void'($value$plusargs("dram_open_page=%d", cfg_open_page));
+        void'($value$plusargs("dram_ckpt_out=%s", ckpt_path));
+        void'($value$plusargs("dram_stats=%s", stats_path));
+        void'($value$plusargs("dram_log=%d", cfg_log_level));
+        dram_config(
+            cfg_n_banks,
+            cfg_row_bytes,
+            cfg_t_cas,
+            cfg_t_rcd,
+            cfg_t_rp,
+            cfg_bus_bytes,
+            cfg_open_page != 0
+        );
+        dram_log_level(cfg_log_level);
+        dram_stats_path(stats_path);
         dram_init(FILENAME);
+        dram_boot_state(boot_pc_val, boot_regs_val);
+    end
+
+    // The model only changes state when a request arrives or a response is
+    // due, so dram_tick is skipped on all other cycles. The wrapper counts
+    // cycles itself and remembers when the next response may be ready.
+    longint cycle      = 0;
+    int     pending    = 0;
+    longint next_ready = -1;
+    longint next_cycle;
+    int     next_pending;
+    longint next_next_ready;
+
+    final begin
+        dram_finish(cycle);
     end
 
     logic        dpi_req_ready;
@@ -67,8 +164,10 @@ module DPIDRAM #(
             dpi_resp_valid <= 0;
             dpi_resp_id <= 0;
             dpi_resp_data <= 0;
-        end else begin
+        end else if (req_valid || !dpi_req_ready || (pending != 0 && cycle + 1 >= next_ready)) begin
+            next_cycle = cycle + 1;
             dram_tick(
+                next_cycle,
                 req_valid,
                 {28'b0, req_bits_id},
                 {32'b0, req_bits_addr},
@@ -80,13 +179,28 @@ module DPIDRAM #(
                 next_req_ready,
                 next_resp_valid,
                 next_resp_id,
-                next_resp_data
+                next_resp_data,
+                next_pending,
+                next_next_ready
             );
             
+            cycle              <= next_cycle;
+            pending            <= next_pending;
+            next_ready         <= next_next_ready;
             dpi_req_ready      <= next_req_ready;
             dpi_resp_valid     <= next_resp_valid;
             dpi_resp_id        <= next_resp_id;
             dpi_resp_data      <= next_resp_data;
+        end else begin
+            // Idle: nothing offered, nothing due
+            cycle              <= cycle + 1;
+            dpi_resp_valid     <= 0;
+        end
+    end
+
+    always @(posedge clock) begin
+        if (!reset && ckpt_valid) begin
+            dram_checkpoint(ckpt_path, ckpt_bits_pc, ckpt_bits_regs);
         end
     end
 
@@ -4,78 +4,489 @@
 #include <iostream>
 #include <iomanip>
 #include <cstring>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <svdpi.h>
 
-// 64MB storage
-static std::vector<uint8_t> mem_storage(64 * 1024 * 1024, 0); 
-static std::ofstream debug_log; 
-static const int DELAY = 20;
+// Sparse backing store covering the full 32-bit address space.
+// 4KB pages are allocated (zero-filled) on first write; untouched pages read
+// as zero. Pages are found through a two-level table indexed by addr[31:22]
+// and addr[21:12].
+class SparseMemory {
+public:
+    static const int PAGE_BITS = 12;
+    static const uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+
+    // Pointer to addr for reading. Never allocates.
+    const uint8_t* read_ptr(uint32_t addr) const {
+        const Leaf* leaf = dir[addr >> 22].get();
+        if (!leaf) return zero_page + (addr & (PAGE_SIZE - 1));
+        const uint8_t* page = leaf->pages[(addr >> PAGE_BITS) & 0x3FF].get();
+        if (!page) return zero_page + (addr & (PAGE_SIZE - 1));
+        return page + (addr & (PAGE_SIZE - 1));
+    }
+
+    // Pointer to addr for writing. Allocates the page if needed.
+    uint8_t* write_ptr(uint32_t addr) {
+        auto& leaf = dir[addr >> 22];
+        if (!leaf) leaf.reset(new Leaf());
+        auto& page = leaf->pages[(addr >> PAGE_BITS) & 0x3FF];
+        if (!page) {
+            page.reset(new uint8_t[PAGE_SIZE]());
+            allocated++;
+        }
+        return page.get() + (addr & (PAGE_SIZE - 1));
+    }
+
+    // Copies n bytes into memory, allocating pages and handling page crossings.
+    void write(uint32_t addr, const void* src, size_t n) {
+        const uint8_t* p = static_cast<const uint8_t*>(src);
+        while (n > 0) {
+            size_t chunk = std::min<size_t>(n, PAGE_SIZE - (addr & (PAGE_SIZE - 1)));
+            memcpy(write_ptr(addr), p, chunk);
+            addr += chunk;
+            p += chunk;
+            n -= chunk;
+        }
+    }
+
+    void clear() {
+        for (auto& leaf : dir) leaf.reset();
+        allocated = 0;
+    }
+
+    size_t allocated_pages() const { return allocated; }
+
+    // Calls f(page_addr, page_data) for every allocated page, in address order.
+    template <typename F>
+    void for_each_page(F f) const {
+        for (uint32_t d = 0; d < 1024; d++) {
+            if (!dir[d]) continue;
+            for (uint32_t p = 0; p < 1024; p++) {
+                const uint8_t* page = dir[d]->pages[p].get();
+                if (page) f((d << 22) | (p << PAGE_BITS), page);
+            }
+        }
+    }
+
+private:
+    struct Leaf {
+        std::unique_ptr<uint8_t[]> pages[1024];
+    };
+    std::unique_ptr<Leaf> dir[1024];
+    size_t allocated = 0;
+    static const uint8_t zero_page[PAGE_SIZE];
+};
+
+const uint8_t SparseMemory::zero_page[SparseMemory::PAGE_SIZE] = {};
+
+
+// Timing model parameters (in DRAM clock cycles, 1:1 with the core clock).
+// Defaults are set from DPIDRAM parameters / plusargs through dram_config.
+struct DramTiming {
+    int n_banks = 8;        // Number of banks (power of two)
+    int row_bytes = 2048;   // Row (page) size in bytes (power of two)
+    int t_cas = 10;         // Column access: open row -> data
+    int t_rcd = 10;         // Activate: closed bank -> row open
+    int t_rp = 10;          // Precharge: close the currently open row
+    int bus_bytes = 8;      // Channel bandwidth in bytes per cycle
+    bool open_page = true;  // Keep rows open after an access
+};
+
+// Per-bank row buffer state
+struct Bank {
+    int64_t open_row = -1;  // -1 when the bank is precharged
+    uint64_t ready_at = 0;  // Earliest cycle the bank accepts a new command
+};
+
+static int log2_int(int v) {
+    int r = 0;
+    while ((1 << r) < v) r++;
+    return r;
+}
 
 // SV Logic is 128 bit data. 
 // svBitVecVal is usually uint32_t.
 // 128 bits = 4 * 32 bits.
 
 struct Response {
+    bool valid = false;
     int id;
-    uint32_t data[4]; // 128 bit (4 32-bit words)
-    int countdown;
+    uint32_t data[4];  // 128 bit (4 32-bit words)
+    uint64_t bus_start; // First cycle of the data transfer on the bus
+    uint64_t ready_at; // Absolute cycle at which the response may be sent
+    uint64_t seq;      // Arrival order
+    uint64_t issued_at; // Cycle the request was accepted
 };
 
-static std::vector<Response> resp_queue;
+// Fixed-capacity table of in-flight responses.
+// Requests complete out of order, as soon as their own timing allows; only
+// responses sharing an ID are returned in arrival order.
+static const int MAX_QUEUE = 16;
 
-extern "C" void dram_init(const char* filename) {
-    debug_log.open("dram.log", std::ios::out | std::ios::trunc);
-    if (!debug_log.is_open()) {
-        std::cerr << "[DPI-C] Fail to open dram.log" << std::endl;
+struct RespTable {
+    Response slots[MAX_QUEUE];
+    int count = 0;
+    uint64_t next_seq = 0;
+    uint64_t earliest = UINT64_MAX; // Smallest ready_at among valid slots
+
+    bool empty() const { return count == 0; }
+    bool full() const { return count == MAX_QUEUE; }
+
+    Response& alloc(int id, uint64_t issued_at, uint64_t bus_start, uint64_t ready_at) {
+        Response* r = slots;
+        while (r->valid) r++;
+        r->valid = true;
+        r->id = id;
+        r->bus_start = bus_start;
+        r->ready_at = ready_at;
+        r->issued_at = issued_at;
+        r->seq = next_seq++;
+        count++;
+        earliest = std::min(earliest, ready_at);
+        return *r;
     }
 
-    if (!filename) {
-        if(debug_log.is_open()) debug_log << "[DPI-C] dram_init called with NULL filename" << std::endl;
-        return;
+    // The response to send at cycle `now`, or nullptr if none is due:
+    // the earliest ready one that has no older pending response with its ID.
+    Response* select(uint64_t now) {
+        if (earliest > now) return nullptr;
+        Response* best = nullptr;
+        for (Response& r : slots) {
+            if (!r.valid || r.ready_at > now) continue;
+            if (best && (r.ready_at > best->ready_at ||
+                         (r.ready_at == best->ready_at && r.seq > best->seq))) continue;
+            bool blocked = false;
+            for (const Response& o : slots) {
+                if (o.valid && o.id == r.id && o.seq < r.seq) { blocked = true; break; }
+            }
+            if (!blocked) best = &r;
+        }
+        return best;
     }
-    if(debug_log.is_open()) debug_log << "[DPI-C] Loading memory from: " << filename << std::endl;
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        if(debug_log.is_open()) debug_log << "[DPI-C] Error: Could not open hex file: " << filename << std::endl;
-        return;
+
+    void release(Response& r) {
+        r.valid = false;
+        count--;
+        earliest = UINT64_MAX;
+        for (const Response& o : slots) {
+            if (o.valid) earliest = std::min(earliest, o.ready_at);
+        }
     }
-    
+};
+
+// Traffic statistics of one instance, queried with dram_stat and dumped as
+// JSON when the simulation ends.
+struct DramStats {
+    static const int N_IDS = 16;
+    static const uint64_t BW_WINDOW = 1024;  // Cycles per bandwidth sample
+
+    uint64_t reads[N_IDS] = {};
+    uint64_t writes[N_IDS] = {};
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+    uint64_t row_hits = 0;
+    uint64_t row_empty = 0;
+    uint64_t row_conflicts = 0;
+    uint64_t completed = 0;
+    uint64_t latency_sum = 0;       // Accept to response, in cycles
+    uint64_t latency_max = 0;
+    uint64_t full_stalls = 0;       // Cycles a request was refused, queue full
+    uint64_t occupancy[MAX_QUEUE + 1] = {}; // Cycles spent with n requests in flight
+    std::vector<uint64_t> bandwidth; // Bytes returned per BW_WINDOW cycles
+};
+
+// Log levels, selected at runtime with +dram_log=<level>.
+// Building with -DDRAM_LOG_MAX_LEVEL=0 removes all logging code.
+enum LogLevel { LOG_OFF = 0, LOG_INFO = 1, LOG_TRACE = 2 };
+#ifndef DRAM_LOG_MAX_LEVEL
+#define DRAM_LOG_MAX_LEVEL LOG_TRACE
+#endif
+
+// Buffered log file. Lines end in '\n' instead of std::endl, so the file is
+// only written when the 1MB buffer fills or the log is closed.
+class LogWriter {
+public:
+    static const size_t BUF_SIZE = 1 << 20;
+
+    bool open(const std::string& path) {
+        file.close();
+        if (!buf) buf.reset(new char[BUF_SIZE]);
+        file.rdbuf()->pubsetbuf(buf.get(), BUF_SIZE); // Must precede open
+        file.open(path, std::ios::out | std::ios::trunc);
+        return file.is_open();
+    }
+    bool is_open() const { return file.is_open(); }
+    std::ostream& stream() { return file; }
+
+private:
+    std::unique_ptr<char[]> buf;
+    std::ofstream file;       // Declared after buf, so it is closed first
+};
+
+// All state of one DPIDRAM instance.
+// Instances are told apart by their DPI scope, so several DPIDRAMs (or several
+// simulations in one process) each own their memory and timing state.
+struct DramModel {
+    SparseMemory mem_storage;
+    LogWriter log;
+    int log_level = LOG_INFO;
+    DramTiming timing;
+    std::vector<Bank> banks = std::vector<Bank>(timing.n_banks);
+    uint64_t now = 0;         // Current DRAM cycle
+    RespTable resp_table;
+    bool req_ready = false;   // req_ready as currently driven by the wrapper
+    int index = 0;            // Creation order, used to name the log file
+    std::string image_path;   // Image passed to dram_init
+    uint32_t boot_pc = 0;     // Architectural state handed to the core at reset
+    uint32_t boot_regs[32] = {};
+    DramStats stats;
+    std::string stats_path;   // JSON statistics file, written once
+    bool stats_dumped = false;
+
+    ~DramModel();
+};
+
+static std::vector<std::unique_ptr<DramModel>> models;
+static std::mutex models_mutex;
+static int models_created = 0;
+static int model_key; // Address used as the svPutUserData key
+
+// Returns the model of the calling DPIDRAM instance, creating it on first use.
+// Must only be called from `context` DPI imports.
+//
+// The model is looked up through the scope on every call. A scope address may
+// be reused by a later simulation in the same process, so caching the pair
+// could hand it the previous run's model.
+static DramModel& current_model() {
+    svScope scope = svGetScope();
+    DramModel* m = static_cast<DramModel*>(svGetUserData(scope, &model_key));
+    if (!m) {
+        std::lock_guard<std::mutex> lock(models_mutex);
+        models.emplace_back(new DramModel());
+        m = models.back().get();
+        m->index = models_created++;
+        svPutUserData(scope, &model_key, m);
+    }
+    return *m;
+}
+
+// Detaches the model of the calling instance from its scope and frees it
+static void release_model() {
+    svScope scope = svGetScope();
+    DramModel* m = static_cast<DramModel*>(svGetUserData(scope, &model_key));
+    if (!m) return;
+    svPutUserData(scope, &model_key, nullptr);
+    std::lock_guard<std::mutex> lock(models_mutex);
+    for (auto it = models.begin(); it != models.end(); ++it) {
+        if (it->get() == m) {
+            models.erase(it);
+            break;
+        }
+    }
+}
+
+// Levels above DRAM_LOG_MAX_LEVEL fold to false at compile time
+static inline bool log_enabled(const DramModel& m, int level) {
+    return level <= DRAM_LOG_MAX_LEVEL && m.log_level >= level && m.log.is_open();
+}
+
+#define DRAM_LOG(m, level, msg) \
+    do { \
+        if (log_enabled((m), (level))) (m).log.stream() << msg << '\n'; \
+    } while (0)
+
+// Earliest cycle >= t at which the data bus is free for `burst` cycles.
+// The bus is occupied by the transfers of the in-flight responses.
+static uint64_t find_bus_slot(const DramModel& m, uint64_t t, uint64_t burst) {
+    bool moved = true;
+    while (moved) {
+        moved = false;
+        for (const Response& r : m.resp_table.slots) {
+            if (r.valid && r.bus_start < t + burst && t < r.ready_at) {
+                t = r.ready_at;
+                moved = true;
+            }
+        }
+    }
+    return t;
+}
+
+// Computes the data transfer window [bus_start, done) of a request issued at
+// `now` and updates the bank state accordingly.
+//
+// Address mapping is row:bank:column, so sequential lines stay in one row and
+// consecutive rows are spread across banks. Each bank serves its requests in
+// arrival order, but a fast request (e.g. a row hit in an idle bank) may take
+// an earlier bus slot than a slower one issued before it.
+static uint64_t schedule_access(DramModel& m, uint32_t addr, int bytes, uint64_t* bus_start) {
+    const DramTiming& timing = m.timing;
+    int col_bits = log2_int(timing.row_bytes);
+    int bank_bits = log2_int(timing.n_banks);
+    Bank& bank = m.banks[(addr >> col_bits) & (timing.n_banks - 1)];
+    int64_t row = addr >> (col_bits + bank_bits);
+
+    uint64_t start = std::max(m.now, bank.ready_at);
+    int latency = timing.t_cas;
+    if (bank.open_row == row) m.stats.row_hits++;
+    else if (bank.open_row < 0) m.stats.row_empty++;
+    else m.stats.row_conflicts++;
+    if (bank.open_row != row) {
+        // Row miss: precharge (if another row is open) then activate
+        latency += timing.t_rcd;
+        if (bank.open_row >= 0) latency += timing.t_rp;
+    }
+
+    uint64_t burst = (bytes + timing.bus_bytes - 1) / timing.bus_bytes;
+    uint64_t data_start = find_bus_slot(m, start + latency, burst);
+    uint64_t done = data_start + burst;
+    *bus_start = data_start;
+
+    // Column commands to an open row pipeline at the burst rate, while a
+    // closed-page bank has to finish and precharge before its next access.
+    bank.open_row = timing.open_page ? row : -1;
+    bank.ready_at = timing.open_page ? data_start - timing.t_cas + burst
+                                     : done + timing.t_rp;
+    return done;
+}
+
+extern "C" void dram_config(
+    int n_banks,
+    int row_bytes,
+    int t_cas,
+    int t_rcd,
+    int t_rp,
+    int bus_bytes,
+    unsigned char open_page
+) {
+    DramModel& m = current_model();
+    DramTiming& timing = m.timing;
+    timing.n_banks = n_banks > 0 ? (1 << log2_int(n_banks)) : 1;
+    timing.row_bytes = row_bytes > 0 ? (1 << log2_int(row_bytes)) : 1;
+    timing.t_cas = std::max(t_cas, 0);
+    timing.t_rcd = std::max(t_rcd, 0);
+    timing.t_rp = std::max(t_rp, 0);
+    timing.bus_bytes = std::max(bus_bytes, 1);
+    timing.open_page = open_page != 0;
+
+    m.banks.assign(timing.n_banks, Bank());
+    m.now = 0;
+}
+
+// Minimal ELF32 definitions, enough to walk the program headers
+struct Elf32Header {
+    uint8_t  e_ident[16];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint32_t e_entry;
+    uint32_t e_phoff;
+    uint32_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+};
+
+struct Elf32ProgramHeader {
+    uint32_t p_type;
+    uint32_t p_offset;
+    uint32_t p_vaddr;
+    uint32_t p_paddr;
+    uint32_t p_filesz;
+    uint32_t p_memsz;
+    uint32_t p_flags;
+    uint32_t p_align;
+};
+
+static const uint32_t PT_LOAD_TYPE = 1;
+static const uint16_t EM_RISCV_MACHINE = 243;
+
+// Read-only mapping of a whole file, unmapped on destruction
+struct MappedFile {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    explicit MappedFile(const char* filename) {
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data = static_cast<const uint8_t*>(p);
+                size = st.st_size;
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data) munmap(const_cast<uint8_t*>(data), size);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+};
+
+static bool is_elf(const MappedFile& file) {
+    return file.size >= sizeof(Elf32Header) && memcmp(file.data, "\x7f" "ELF", 4) == 0;
+}
+
+// Loads every PT_LOAD segment at its physical address.
+// Bytes between p_filesz and p_memsz (.bss) are left zero.
+static size_t load_elf(DramModel& m, const MappedFile& file) {
+    Elf32Header eh;
+    memcpy(&eh, file.data, sizeof(eh));
+    if (eh.e_ident[4] != 1 || eh.e_ident[5] != 1) {
+        throw std::runtime_error("DRAM init: only little-endian ELF32 images are supported.");
+    }
+    if (eh.e_machine != EM_RISCV_MACHINE) {
+        throw std::runtime_error("DRAM init: ELF image is not a RISC-V executable.");
+    }
+
+    size_t loaded = 0;
+    for (int i = 0; i < eh.e_phnum; i++) {
+        size_t off = eh.e_phoff + (size_t)i * eh.e_phentsize;
+        if (off + sizeof(Elf32ProgramHeader) > file.size) {
+            throw std::runtime_error("DRAM init: truncated ELF program header table.");
+        }
+        Elf32ProgramHeader ph;
+        memcpy(&ph, file.data + off, sizeof(ph));
+        if (ph.p_type != PT_LOAD_TYPE || ph.p_filesz == 0) continue;
+        if ((size_t)ph.p_offset + ph.p_filesz > file.size) {
+            throw std::runtime_error("DRAM init: ELF segment exceeds file size.");
+        }
+        m.mem_storage.write(ph.p_paddr, file.data + ph.p_offset, ph.p_filesz);
+        loaded += ph.p_filesz;
+        DRAM_LOG(m, LOG_INFO, "[DPI-C] ELF segment: 0x" << std::hex << ph.p_paddr
+                 << " (" << std::dec << ph.p_filesz << " bytes)");
+    }
+    m.boot_pc = eh.e_entry;
+    return loaded;
+}
+
+// Loads a raw binary image at address 0
+static size_t load_raw(DramModel& m, const MappedFile& file) {
+    m.mem_storage.write(0, file.data, file.size);
+    return file.size;
+}
+
+// Loads a text hex file: 32-bit words or little-endian byte groups,
+// `@addr` directives and `//` comments.
+static size_t load_hex(DramModel& m, std::ifstream& file) {
     std::string token;
     uint32_t addr = 0;
-    int inst_count = 0;
-    
-    // Reset memory
-    std::fill(mem_storage.begin(), mem_storage.end(), 0);
-
-    // while (std::getline(file, line)) {
-    //     lines_read++;
-    //     // Strip comments
-    //     size_t comment = line.find("//");
-    //     if (comment != std::string::npos) line = line.substr(0, comment);
-        
-    //     while (!line.empty() && isspace(line.back())) line.pop_back();
-    //     while (!line.empty() && isspace(line.front())) line.erase(0, 1);
-        
-    //     if (line.empty()) continue;
-        
-    //     if (line[0] == '@') {
-    //         throw std::runtime_error("DRAM init does not support address directives (@).");
-    //     }
-
-    //     try {
-    //         uint32_t val = (uint32_t)std::stoul(line, nullptr, 16);
-            
-    //         if (addr + 4 <= mem_storage.size()) {
-    //             mem_storage[addr+0] = val & 0xFF;
-    //             mem_storage[addr+1] = (val >> 8) & 0xFF;
-    //             mem_storage[addr+2] = (val >> 16) & 0xFF;
-    //             mem_storage[addr+3] = (val >> 24) & 0xFF;
-    //             addr += 4;
-    //             loaded += 4;
-    //         }
-    //     } catch (...) {
-    //     }
-    // }
+    size_t loaded = 0;
 
     // read in one token at a time
     while (file >> token) {
@@ -113,29 +524,295 @@ extern "C" void dram_init(const char* filename) {
                 throw std::runtime_error("Invalid token length in hex file: " + token);
             }
             // store to memory
-            if (addr + 4 <= mem_storage.size()) {
-                mem_storage[addr+0] = val & 0xFF;
-                mem_storage[addr+1] = (val >> 8) & 0xFF;
-                mem_storage[addr+2] = (val >> 16) & 0xFF;
-                mem_storage[addr+3] = (val >> 24) & 0xFF;
-                addr += 4;
-                inst_count++;
-            } else {
-                throw std::runtime_error("DRAM init: Address out of bounds while loading data.");
-            }
+            m.mem_storage.write(addr, &val, 4);
+            addr += 4;
+            loaded += 4;
+        }
+    }
+
+    return loaded;
+}
+
+// Checkpoint file: header followed by every non-zero page as
+// { uint32_t page_addr; uint8_t data[PAGE_SIZE]; }
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pc;             // Next instruction to execute
+    uint32_t regs[32];       // Architectural registers x0-x31
+    uint32_t n_pages;
+};
+
+static const char CKPT_MAGIC[8] = {'B', 'O', 'O', 'M', 'C', 'K', 'P', 'T'};
+static const uint32_t CKPT_VERSION = 1;
+
+static bool is_checkpoint(const MappedFile& file) {
+    return file.size >= sizeof(CheckpointHeader) && memcmp(file.data, CKPT_MAGIC, sizeof(CKPT_MAGIC)) == 0;
+}
+
+// Restores memory pages and the boot state from a checkpoint
+static size_t load_checkpoint(DramModel& m, const MappedFile& file) {
+    CheckpointHeader h;
+    memcpy(&h, file.data, sizeof(h));
+    if (h.version != CKPT_VERSION) {
+        throw std::runtime_error("DRAM init: unsupported checkpoint version " + std::to_string(h.version));
+    }
+    const size_t record = sizeof(uint32_t) + SparseMemory::PAGE_SIZE;
+    if (sizeof(h) + (size_t)h.n_pages * record > file.size) {
+        throw std::runtime_error("DRAM init: truncated checkpoint file.");
+    }
+
+    const uint8_t* p = file.data + sizeof(h);
+    for (uint32_t i = 0; i < h.n_pages; i++, p += record) {
+        uint32_t page_addr;
+        memcpy(&page_addr, p, sizeof(page_addr));
+        m.mem_storage.write(page_addr, p + sizeof(page_addr), SparseMemory::PAGE_SIZE);
+    }
+    m.boot_pc = h.pc;
+    memcpy(m.boot_regs, h.regs, sizeof(m.boot_regs));
+    m.boot_regs[0] = 0;
+    DRAM_LOG(m, LOG_INFO, "[DPI-C] Restored checkpoint: pc=0x" << std::hex << h.pc << std::dec
+             << " (" << h.n_pages << " pages)");
+    return (size_t)h.n_pages * SparseMemory::PAGE_SIZE;
+}
+
+static bool page_is_zero(const uint8_t* page) {
+    for (uint32_t i = 0; i < SparseMemory::PAGE_SIZE; i++) {
+        if (page[i]) return false;
+    }
+    return true;
+}
+
+// Writes memory and the architectural state captured by the core.
+// An empty path defaults to <image>.ckpt next to the loaded image.
+extern "C" void dram_checkpoint(const char* path, int pc, const svBitVecVal* regs) {
+    DramModel& m = current_model();
+    std::string out = (path && path[0]) ? std::string(path) : m.image_path + ".ckpt";
+
+    CheckpointHeader h = {};
+    memcpy(h.magic, CKPT_MAGIC, sizeof(CKPT_MAGIC));
+    h.version = CKPT_VERSION;
+    h.pc = (uint32_t)pc;
+    for (int i = 0; i < 32; i++) h.regs[i] = regs[i];
+    h.regs[0] = 0;
+    m.mem_storage.for_each_page([&](uint32_t, const uint8_t* page) {
+        if (!page_is_zero(page)) h.n_pages++;
+    });
+
+    std::ofstream file(out, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "[DPI-C] Fail to open checkpoint file " << out << std::endl;
+        return;
+    }
+    file.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    m.mem_storage.for_each_page([&](uint32_t page_addr, const uint8_t* page) {
+        if (page_is_zero(page)) return;
+        file.write(reinterpret_cast<const char*>(&page_addr), sizeof(page_addr));
+        file.write(reinterpret_cast<const char*>(page), SparseMemory::PAGE_SIZE);
+    });
+
+    DRAM_LOG(m, LOG_INFO, "[DPI-C] Cycle " << m.now << ": checkpoint written to " << out
+             << " (pc=0x" << std::hex << h.pc << std::dec << ", " << h.n_pages << " pages)");
+}
+
+// Initial PC and register values for the core: the ELF entry point,
+// the state saved in a checkpoint, or zeros for other images.
+extern "C" void dram_boot_state(int* pc, svBitVecVal* regs) {
+    DramModel& m = current_model();
+    *pc = (int)m.boot_pc;
+    for (int i = 0; i < 32; i++) regs[i] = m.boot_regs[i];
+}
+
+static bool has_suffix(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+extern "C" void dram_init(const char* filename) {
+    DramModel& m = current_model();
+    // The first instance logs to dram.log, later ones to dram.<n>.log.
+    // No file is created when logging is off.
+    if (DRAM_LOG_MAX_LEVEL > LOG_OFF && m.log_level > LOG_OFF) {
+        std::string log_name = m.index == 0 ? "dram.log" : "dram." + std::to_string(m.index) + ".log";
+        if (!m.log.open(log_name)) {
+            std::cerr << "[DPI-C] Fail to open " << log_name << std::endl;
+        }
+    }
+
+    if (!filename) {
+        DRAM_LOG(m, LOG_INFO, "[DPI-C] dram_init called with NULL filename");
+        return;
+    }
+    DRAM_LOG(m, LOG_INFO, "[DPI-C] Timing: banks=" << m.timing.n_banks
+             << " row=" << m.timing.row_bytes << "B"
+             << " tCAS=" << m.timing.t_cas << " tRCD=" << m.timing.t_rcd
+             << " tRP=" << m.timing.t_rp << " bus=" << m.timing.bus_bytes << "B/cycle"
+             << (m.timing.open_page ? " open-page" : " closed-page"));
+    DRAM_LOG(m, LOG_INFO, "[DPI-C] Loading memory from: " << filename);
+
+    if (m.stats_path.empty()) {
+        m.stats_path = m.index == 0 ? "dram_stats.json" : "dram_stats." + std::to_string(m.index) + ".json";
+    }
+
+    // Reset memory, in-flight requests, boot state and statistics
+    m.mem_storage.clear();
+    m.resp_table = RespTable();
+    m.req_ready = false;
+    m.banks.assign(m.timing.n_banks, Bank());
+    m.now = 0;
+    m.stats = DramStats();
+    m.stats_dumped = false;
+    m.image_path = filename;
+    m.boot_pc = 0;
+    memset(m.boot_regs, 0, sizeof(m.boot_regs));
+
+    // The image format is picked by content (ELF or checkpoint magic) or by
+    // extension (.bin for raw binaries); anything else is parsed as a hex file.
+    size_t loaded = 0;
+    MappedFile image(filename);
+    if (image.data && is_checkpoint(image)) {
+        loaded = load_checkpoint(m, image);
+    } else if (image.data && is_elf(image)) {
+        loaded = load_elf(m, image);
+    } else if (image.data && has_suffix(filename, ".bin")) {
+        loaded = load_raw(m, image);
+    } else {
+        std::ifstream file(filename);
+        if (!file.is_open()) {
+            DRAM_LOG(m, LOG_INFO, "[DPI-C] Error: Could not open image file: " << filename);
+            return;
         }
+        loaded = load_hex(m, file);
+    }
+
+    DRAM_LOG(m, LOG_INFO, "[DPI-C] Initialized RAM from " << filename << " (" << loaded << " bytes loaded, "
+             << m.mem_storage.allocated_pages() << " pages)");
+    if (log_enabled(m, LOG_INFO)) {
+        std::ostream& os = m.log.stream();
+        os << "[DPI-C] Memory Head (0x00): ";
+        os << std::hex << std::setfill('0');
+        for(int i=0; i<16; i++) os << std::setw(2) << (int)m.mem_storage.read_ptr(0)[i] << " ";
+        os << std::dec << '\n';
+    }
+}
+
+// Value of a named statistic, see docs/dram.md. Per-ID counters are
+// addressed as "reads:<id>" / "writes:<id>".
+static bool stat_value(const DramModel& m, const std::string& name, uint64_t* out) {
+    const DramStats& st = m.stats;
+    size_t colon = name.find(':');
+    if (colon != std::string::npos) {
+        std::string base = name.substr(0, colon);
+        int id = std::atoi(name.c_str() + colon + 1);
+        if (id < 0 || id >= DramStats::N_IDS) return false;
+        if (base == "reads") { *out = st.reads[id]; return true; }
+        if (base == "writes") { *out = st.writes[id]; return true; }
+        return false;
+    }
+    uint64_t reads = 0, writes = 0;
+    for (int i = 0; i < DramStats::N_IDS; i++) {
+        reads += st.reads[i];
+        writes += st.writes[i];
+    }
+    if (name == "cycles") *out = m.now;
+    else if (name == "reads") *out = reads;
+    else if (name == "writes") *out = writes;
+    else if (name == "bytes_read") *out = st.bytes_read;
+    else if (name == "bytes_written") *out = st.bytes_written;
+    else if (name == "row_hits") *out = st.row_hits;
+    else if (name == "row_empty") *out = st.row_empty;
+    else if (name == "row_conflicts") *out = st.row_conflicts;
+    else if (name == "completed") *out = st.completed;
+    else if (name == "latency_sum") *out = st.latency_sum;
+    else if (name == "latency_max") *out = st.latency_max;
+    else if (name == "full_stalls") *out = st.full_stalls;
+    else if (name == "in_flight") *out = m.resp_table.count;
+    else return false;
+    return true;
+}
+
+// Returns the named statistic of the calling instance, or -1 if unknown
+extern "C" long long dram_stat(const char* name) {
+    uint64_t v;
+    if (!name || !stat_value(current_model(), name, &v)) return -1;
+    return (long long)v;
+}
+
+static void write_stats_json(const DramModel& m, std::ostream& os) {
+    const DramStats& st = m.stats;
+    auto list = [&](const uint64_t* v, size_t n) {
+        os << "[";
+        for (size_t i = 0; i < n; i++) os << (i ? ", " : "") << v[i];
+        os << "]";
+    };
+    uint64_t v;
+    os << "{\n";
+    for (const char* name : {"cycles", "reads", "writes", "bytes_read", "bytes_written",
+                             "row_hits", "row_empty", "row_conflicts", "completed",
+                             "latency_max", "full_stalls"}) {
+        stat_value(m, name, &v);
+        os << "  \"" << name << "\": " << v << ",\n";
     }
+    double avg = st.completed ? (double)st.latency_sum / st.completed : 0.0;
+    double bytes_per_cycle = m.now ? (double)(st.bytes_read + st.bytes_written) / m.now : 0.0;
+    os << "  \"latency_avg\": " << avg << ",\n";
+    os << "  \"bytes_per_cycle\": " << bytes_per_cycle << ",\n";
+    os << "  \"reads_by_id\": "; list(st.reads, DramStats::N_IDS); os << ",\n";
+    os << "  \"writes_by_id\": "; list(st.writes, DramStats::N_IDS); os << ",\n";
+    os << "  \"occupancy_histogram\": "; list(st.occupancy, MAX_QUEUE + 1); os << ",\n";
+    os << "  \"bandwidth_window\": " << DramStats::BW_WINDOW << ",\n";
+    os << "  \"bandwidth_bytes\": "; list(st.bandwidth.data(), st.bandwidth.size()); os << "\n";
+    os << "}\n";
+}
 
-    if(debug_log.is_open()) {
-        debug_log << "[DPI-C] Initialized RAM from " << filename << " (" << inst_count * 4 << " bytes loaded)" << std::endl;
-        debug_log << "[DPI-C] Memory Head (0x00): ";
-        debug_log << std::hex << std::setfill('0');
-        for(int i=0; i<16; i++) debug_log << std::setw(2) << (int)mem_storage[i] << " ";
-        debug_log << std::dec << std::endl;
+static void dump_stats(DramModel& m) {
+    if (m.stats_dumped || m.stats_path.empty()) return;
+    m.stats_dumped = true;
+    std::ofstream file(m.stats_path, std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "[DPI-C] Fail to open " << m.stats_path << std::endl;
+        return;
     }
+    write_stats_json(m, file);
+    DRAM_LOG(m, LOG_INFO, "[DPI-C] Statistics written to " << m.stats_path);
 }
 
+// Simulators that skip `final` blocks still get the statistics at exit
+DramModel::~DramModel() { dump_stats(*this); }
+
+// Sets the log level (+dram_log), called before dram_init
+extern "C" void dram_log_level(int level) {
+    current_model().log_level = std::max((int)LOG_OFF, std::min(level, (int)LOG_TRACE));
+}
+
+// Overrides the statistics file, called before dram_init
+extern "C" void dram_stats_path(const char* path) {
+    if (path && path[0]) current_model().stats_path = path;
+}
+
+// Moves the model to `cycle`. Nothing changes in cycles without a dram_tick
+// call, so skipped cycles only need to be accounted for in the statistics.
+static void advance_to(DramModel& m, uint64_t cycle) {
+    if (cycle <= m.now) return;
+    m.stats.occupancy[m.resp_table.count] += cycle - m.now;
+    m.now = cycle;
+}
+
+// Called from the SV `final` block with the last cycle of the run.
+// The model is freed afterwards; a later call from the same scope starts a
+// new one.
+extern "C" void dram_finish(long long cycle) {
+    DramModel& m = current_model();
+    advance_to(m, (uint64_t)cycle);
+    dump_stats(m);
+    release_model();
+}
+
+// Processes cycle `cycle`. The SV wrapper registers the outputs and only
+// calls this when a request is offered, req_ready is low, or a response may
+// be due (pending > 0 and cycle >= next_ready). In every other cycle the
+// call would change nothing, and the wrapper holds req_ready.
 extern "C" void dram_tick(
+    long long cycle,            // Current cycle, counted by the wrapper
     unsigned char req_valid,    // 1 bit
     int req_id,                 // 32 bit (int)
     long long req_addr,         // 64 bit (long long)
@@ -147,108 +824,101 @@ extern "C" void dram_tick(
     unsigned char* req_ready,   // output 1 bit
     unsigned char* resp_valid,  // output 1 bit
     int* resp_id,               // output 32 bit
-    svBitVecVal* resp_data      // output 128 bit -> 4x uint32
+    svBitVecVal* resp_data,     // output 128 bit -> 4x uint32
+    int* pending,               // output: responses in flight
+    long long* next_ready       // output: earliest cycle one may be due, -1 if none
 ) {
-    const int MAX_QUEUE = 16; 
-    const uint32_t DRAM_BASE = 0x00000000; // User requested 0 base
+    DramModel& m = current_model();
+    advance_to(m, (uint64_t)cycle);
 
     // 1. Process Queue & Drive Output
     *resp_valid = 0;
     *resp_id = 0;
-    resp_data[0] = 0; resp_data[1] = 0; resp_data[2] = 0; resp_data[3] = 0;
-
-    // Tick down delays
-    for (auto& r : resp_queue) {
-        if (r.countdown > 0) r.countdown--;
-    }
-
-    if (!resp_queue.empty()) {
-        const auto& head = resp_queue.front();
-        if (head.countdown == 0 && resp_ready) {
-            *resp_valid = 1;
-            *resp_id = head.id;
-            if(debug_log.is_open()) {
-                 debug_log << "[DPI-C] Popping RESP ID: " << head.id 
-                 << " Data: " << std::hex 
-                 << head.data[3] << "_" << head.data[2] << "_" << head.data[1] << "_" << head.data[0] 
-                 << std::dec << std::endl;
-            }
+    memset(resp_data, 0, 16);
 
-            // Use memcpy to avoid any type/pointer arithmetic issues
-            memcpy(resp_data, head.data, 16);
+    Response* head = resp_ready ? m.resp_table.select(m.now) : nullptr;
+    if (head) {
+        *resp_valid = 1;
+        *resp_id = head->id;
+        DRAM_LOG(m, LOG_TRACE, "[DPI-C] Popping RESP ID: " << head->id
+                 << " Data: " << std::hex
+                 << head->data[3] << "_" << head->data[2] << "_" << head->data[1] << "_" << head->data[0]
+                 << std::dec);
 
-            resp_queue.erase(resp_queue.begin());
-        }
+        memcpy(resp_data, head->data, 16);
+
+        uint64_t latency = m.now - head->issued_at;
+        m.stats.completed++;
+        m.stats.latency_sum += latency;
+        m.stats.latency_max = std::max(m.stats.latency_max, latency);
+        size_t window = m.now / DramStats::BW_WINDOW;
+        if (window >= m.stats.bandwidth.size()) m.stats.bandwidth.resize(window + 1);
+        m.stats.bandwidth[window] += 16;
+
+        m.resp_table.release(*head);
     }
 
     // 2. Accept New Request
-    bool can_accept = (resp_queue.size() < MAX_QUEUE);
-    *req_ready = can_accept ? 1 : 0;
+    // A request is taken only if the wrapper showed req_ready this cycle
+    bool can_accept = m.req_ready && !m.resp_table.full();
+    if (req_valid && !can_accept) m.stats.full_stalls++;
 
+    // Lines are copied with memcpy: both the host and RV32 are little-endian,
+    // so byte i of a line is byte (i % 4) of svBitVecVal word (i / 4).
     if (req_valid && can_accept) {
         uint32_t raw_addr = (uint32_t)req_addr;
-        uint32_t offset = raw_addr; // default
-        bool in_range = false;
-
-        // Check bounds
-        if (raw_addr >= DRAM_BASE && raw_addr < DRAM_BASE + mem_storage.size()) {
-            offset = raw_addr - DRAM_BASE;
-            in_range = true;
-        }
+        // Requests are whole lines, so a line never straddles a page
+        uint32_t line_addr = raw_addr & ~0xFu;
 
-        if (!in_range) {
-             if(debug_log.is_open()) debug_log << "[DPI-C] WARNING: Access Out of Bounds: 0x" << std::hex << raw_addr << std::dec << std::endl;
+        // Prepare response in place
+        uint64_t bus_start;
+        uint64_t ready_at = schedule_access(m, line_addr, 16, &bus_start);
+        Response& resp = m.resp_table.alloc(req_id, m.now, bus_start, ready_at);
+        if (req_isWr) {
+            m.stats.writes[req_id & (DramStats::N_IDS - 1)]++;
+            m.stats.bytes_written += 16;
+        } else {
+            m.stats.reads[req_id & (DramStats::N_IDS - 1)]++;
+            m.stats.bytes_read += 16;
         }
 
-        // Prepare response
-        Response resp;
-        resp.id = req_id;
-        resp.countdown = DELAY;
-        memset(resp.data, 0, sizeof(resp.data)); // Clear data
-
         if (req_isWr) {
-            if (in_range) {
-                 // Write 128 bits (16 bytes) with mask
-                 for (int i=0; i<16; i++) {
-                     if ((req_mask >> i) & 1) {
-                         // Extract byte from req_data
-                         // req_data is array of uint32.
-                         int word_idx = i / 4;
-                         int byte_shift = (i % 4) * 8;
-                         uint8_t b = (req_data[word_idx] >> byte_shift) & 0xFF;
-                         
-                         if (offset + i < mem_storage.size()) {
-                             mem_storage[offset + i] = b;
-                         }
-                     }
-                 }
+            uint8_t* line = m.mem_storage.write_ptr(line_addr);
+            if ((req_mask & 0xFFFF) == 0xFFFF) {
+                memcpy(line, req_data, 16);
+            } else {
+                // Masked store, one 32-bit word at a time
+                for (int w = 0; w < 4; w++) {
+                    int nibble = (req_mask >> (w * 4)) & 0xF;
+                    if (!nibble) continue;
+                    uint32_t byte_mask = 0;
+                    for (int b = 0; b < 4; b++) {
+                        if ((nibble >> b) & 1) byte_mask |= 0xFFu << (b * 8);
+                    }
+                    uint32_t word;
+                    memcpy(&word, line + w * 4, 4);
+                    word = (word & ~byte_mask) | (req_data[w] & byte_mask);
+                    memcpy(line + w * 4, &word, 4);
+                }
             }
-            resp_queue.push_back(resp); // Write ack
+            memset(resp.data, 0, sizeof(resp.data)); // Write ack
         } else {
             // Read
-            if (in_range && (offset + 16 <= mem_storage.size())) {
-                // Populate resp.data (128 bits)
-                for (int i=0; i<16; i++) {
-                    uint8_t b = mem_storage[offset + i];
-                    int word_idx = i / 4;
-                    int byte_shift = (i % 4) * 8;
-                    resp.data[word_idx] |= ((uint32_t)b) << byte_shift;
-                }
-                
-                // Debug print for reads
-                if(debug_log.is_open()) {
-                    debug_log << "[DPI-C] READ Addr: 0x" << std::hex << std::setw(8) << std::setfill('0') << raw_addr 
-                              << " ID: " << req_id
-                              << " -> Data: " << std::setw(8) << resp.data[0] << " " << std::setw(8) << resp.data[1] 
-                              << " ..." << std::dec << std::endl;
-                }
-            } // Close in_range
-            
-            if(debug_log.is_open()) {
-                debug_log << "[DPI-C] Pushing RESP to Queue. ID: " << resp.id << " Data: " 
-                          << std::hex << resp.data[3] << "_" << resp.data[2] << "_" << resp.data[1] << "_" << resp.data[0] << std::dec << std::endl;
-            }
-            resp_queue.push_back(resp);
-        } // Close else
-    } // Close if(req_valid)
-} // Close function
+            memcpy(resp.data, m.mem_storage.read_ptr(line_addr), 16);
+
+            // Debug print for reads
+            DRAM_LOG(m, LOG_TRACE, "[DPI-C] READ Addr: 0x" << std::hex << std::setw(8) << std::setfill('0') << raw_addr
+                     << " ID: " << req_id
+                     << " -> Data: " << std::setw(8) << resp.data[0] << " " << std::setw(8) << resp.data[1]
+                     << " ..." << std::dec);
+            DRAM_LOG(m, LOG_TRACE, "[DPI-C] Pushing RESP to Queue. ID: " << resp.id << " Data: "
+                     << std::hex << resp.data[3] << "_" << resp.data[2] << "_" << resp.data[1] << "_" << resp.data[0] << std::dec);
+        }
+    }
+
+    // 3. State for the next cycle
+    m.req_ready = !m.resp_table.full();
+    *req_ready = m.req_ready ? 1 : 0;
+    *pending = m.resp_table.count;
+    *next_ready = m.resp_table.empty() ? -1 : (long long)m.resp_table.earliest;
+}
@@ -0,0 +1,127 @@
+// Microbenchmark for the DPI DRAM model (resources/dram.cc).
+//
+// Drives dram_tick directly, without Verilator, and reports the average host
+// time per simulated cycle. The traffic mix resembles the caches: bursts of
+// line reads and full-line writebacks separated by idle cycles.
+//
+// Build & run (svdpi.h ships with Verilator):
+//   VLTSTD=$(verilator --getenv VERILATOR_ROOT)/include/vltstd
+//   g++ -O2 -std=c++17 -I$VLTSTD scripts/dram_bench.cc -o dram_bench
+//   ./dram_bench [cycles] [idle cycles] [log level]
+//
+// Add -DDRAM_LOG_MAX_LEVEL=0 to measure the build without logging code.
+//
+// To compare against another revision of the model:
+//   git show <rev>:resources/dram.cc > /tmp/dram_old.cc
+//   g++ ... -DDRAM_CC='"/tmp/dram_old.cc"' scripts/dram_bench.cc -o dram_bench_old
+//
+// Revisions before the cycle-skipping dram_tick are called every cycle, like
+// their wrapper did.
+
+#ifndef DRAM_CC
+#define DRAM_CC "../resources/dram.cc"
+#endif
+#include DRAM_CC
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <type_traits>
+
+// Stand-ins for the simulator's DPI scope API, with a single fixed scope
+static std::map<void*, void*> user_data;
+extern "C" svScope svGetScope() { return &user_data; }
+extern "C" void* svGetUserData(const svScope, void* key) {
+    auto it = user_data.find(key);
+    return it == user_data.end() ? nullptr : it->second;
+}
+extern "C" int svPutUserData(const svScope, void* key, void* data) {
+    user_data[key] = data;
+    return 0;
+}
+
+// dram_tick with the absolute cycle in and pending/next_ready out. Earlier
+// revisions take neither.
+template <typename Tick>
+constexpr bool skips_cycles = std::is_invocable_v<
+    Tick, long long, unsigned char, int, long long, unsigned char,
+    const svBitVecVal*, int, unsigned char, unsigned char*, unsigned char*,
+    int*, svBitVecVal*, int*, long long*>;
+using DramTick = decltype(&dram_tick);
+
+// Calls either signature. `fn` is a parameter so that only the branch
+// matching dram.cc is compiled.
+template <typename Tick>
+static void tick(
+    Tick fn, long long cycle, bool req_valid, int req_id, uint32_t req_addr,
+    bool req_isWr, const svBitVecVal* req_data, unsigned char* req_ready,
+    unsigned char* resp_valid, int* resp_id, svBitVecVal* resp_data,
+    int* pending, long long* next_ready
+) {
+    if constexpr (skips_cycles<Tick>) {
+        fn(
+            cycle, req_valid, req_id, req_addr, req_isWr, req_data, 0xFFFF, 1,
+            req_ready, resp_valid, resp_id, resp_data, pending, next_ready
+        );
+    } else {
+        (void)cycle, (void)pending, (void)next_ready;
+        fn(
+            req_valid, req_id, req_addr, req_isWr, req_data, 0xFFFF, 1,
+            req_ready, resp_valid, resp_id, resp_data
+        );
+    }
+}
+
+int main(int argc, char** argv) {
+    const long cycles = argc > 1 ? atol(argv[1]) : 10000000;
+    const int idle = argc > 2 ? atoi(argv[2]) : 4; // idle cycles between requests
+    const int log_level = argc > 3 ? atoi(argv[3]) : 0; // as +dram_log
+
+    // dram.cc opens dram.log in dram_init. By default it is left closed so
+    // that only the model itself is measured. Revisions before the log levels
+    // do not define DRAM_LOG_MAX_LEVEL and always log.
+    if (log_level > 0) {
+#ifdef DRAM_LOG_MAX_LEVEL
+        dram_log_level(log_level);
+#else
+        fprintf(stderr, "dram.cc has no log levels, logging everything\n");
+#endif
+        dram_init("/dev/null");
+    }
+    svBitVecVal req_data[4] = {0x11111111, 0x22222222, 0x33333333, 0x44444444};
+    svBitVecVal resp_data[4];
+    unsigned char req_ready = 0, resp_valid = 0;
+    int resp_id = 0, pending = 0;
+    long long next_ready = -1;
+    long responses = 0, calls = 0;
+    uint32_t addr = 0;
+
+    // Calls are skipped exactly like DPIDRAM.sv does
+    auto start = std::chrono::steady_clock::now();
+    for (long c = 1; c <= cycles; c++) {
+        bool issue = (c % (idle + 1)) == 0;
+        bool due = pending != 0 && c >= next_ready;
+        if (skips_cycles<DramTick> && !issue && req_ready && !due) {
+            resp_valid = 0;
+            continue;
+        }
+        bool is_wr = issue && (c / (idle + 1)) % 4 == 3;
+        bool accepted = issue && req_ready;
+        tick(
+            &dram_tick, c, issue, is_wr ? 0 : 1, addr, is_wr, req_data,
+            &req_ready, &resp_valid, &resp_id, resp_data, &pending, &next_ready
+        );
+        calls++;
+        if (accepted) addr = (addr + 16) & 0xFFFFF;
+        responses += resp_valid;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    printf("cycles:      %ld\n", cycles);
+    printf("responses:   %ld\n", responses);
+    printf("dpi calls:   %ld\n", calls);
+    printf("ns / cycle:  %.2f\n", ns / cycles);
+    return 0;
+}
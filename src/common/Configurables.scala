@@ -8,6 +8,9 @@ object Configurables {
     val IMEM_WIDTH = 12     // 4096 words = 16KB instruction memory
     val MEM_WIDTH  = 14     // 16KB data memory (8-bit per slot)
     val RAS_WIDTH  = 3      // Return Address Stack size
+    val MEM_TAG_WIDTH = 2   // Loads/stores in flight between the LSU and memory
+    val FETCH_PACKET_WIDTH = 2 // 4 instructions per fetch packet
+    val GHIST_WIDTH = 10    // Global branch history bits (gshare rows)
     
     val WALLACE_RDEPTH = 6  // Number of reduction iterations per Wallace tree layer
 
@@ -62,6 +65,16 @@ object Configurables {
         }
     }
 
+    // Simulation-only features.
+    // They will automatically be disabled in synthesis builds.
+    object Simulation {
+        var checkpointing: Boolean = true    // Checkpoint architectural state and DRAM, boot from a checkpoint
+
+        def prune() = {
+            checkpointing = false
+        }
+    }
+
     // MMIO Addresses
     object MMIOAddress {
         val EXIT_ADDR = "hFFFFFFFF" // Write byte to this address to exit the program
@@ -75,5 +88,7 @@ object Configurables {
         val IMEM_SIZE  = 1 << IMEM_WIDTH
         val MEM_SIZE   = 1 << MEM_WIDTH
         val RAS_SIZE   = 1 << RAS_WIDTH
+        val MEM_TAG_COUNT = 1 << MEM_TAG_WIDTH
+        val FETCH_PACKET_SIZE = 1 << FETCH_PACKET_WIDTH
     }
 }
@@ -5,6 +5,14 @@ import chisel3.util._
 import Configurables._
 import Configurables.Derived._
 
+/** Direction predictor state of a fetched instruction. It comes back with the
+  * branch update to train the predictor and repair the global history.
+  */
+class BranchPredictorMeta extends Bundle {
+    val ghist = UInt(GHIST_WIDTH.W) // History the packet was predicted with
+    val counter = UInt(2.W) // Counter read for the instruction's slot
+}
+
 /** Instruction Fetch output bundle definition.
   */
 class FetchToDecodeBundle extends Bundle {
@@ -12,6 +20,30 @@ class FetchToDecodeBundle extends Bundle {
     val inst = UInt(32.W)
     val predict = Bool()
     val predictedTarget = UInt(32.W)
+    val bpMeta = new BranchPredictorMeta
+}
+
+/** Instruction cache response: the aligned fetch packet holding the requested
+  * address. `mask` marks the slots from the requested one to the end of the
+  * packet.
+  */
+class ICacheResp extends Bundle {
+    val insts = Vec(FETCH_PACKET_SIZE, UInt(32.W))
+    val mask = UInt(FETCH_PACKET_SIZE.W)
+}
+
+/** Fetch packet passed from the fetcher to the fetch queue.
+  *
+  * Only the last valid slot can be predicted taken, the packet ends there.
+  */
+class FetchPacket extends Bundle {
+    val pc = UInt(32.W) // Address of slot 0
+    val insts = Vec(FETCH_PACKET_SIZE, UInt(32.W))
+    val mask = UInt(FETCH_PACKET_SIZE.W)
+    val predict = Bool() // Last valid slot is a predicted-taken branch
+    val predictedTarget = UInt(32.W)
+    val ghist = UInt(GHIST_WIDTH.W)
+    val counters = Vec(FETCH_PACKET_SIZE, UInt(2.W))
 }
 
 /** Micro-operation bundle definition.
@@ -36,6 +68,7 @@ class DecodedInstBundle extends Bundle {
     val pc = UInt(32.W)
     val predict = Bool()
     val predictedTarget = UInt(32.W)
+    val bpMeta = new BranchPredictorMeta
     // - register renaming info
     val lrs1, lrs2, ldst = UInt(5.W) // logical registers
     val prs1, prs2, pdst = UInt(PREG_WIDTH.W) // physical registers
@@ -119,6 +152,8 @@ class BranchUpdateBundle extends Bundle {
     val predict = Bool()
     val predictedTarget = UInt(32.W)
     val rasSP = UInt(RAS_WIDTH.W)
+    val isCond = Bool() // Conditional branch, trains the direction predictor
+    val bpMeta = new BranchPredictorMeta
 }
 
 class FlushBundle extends Bundle {
@@ -152,19 +187,37 @@ class LoadStoreAction extends Bundle {
     val addr = UInt(32.W)
     val data = UInt(32.W)
     val targetReg = UInt(PREG_WIDTH.W)
+    // Completion tag, returned with the response (ignored by MMIO devices)
+    val tag = UInt(MEM_TAG_WIDTH.W)
 }
 
 class RASAdaptorBundle extends Bundle {
     val flush = Bool()
     val flushNextPC = UInt(32.W)
     val currentSP = UInt(RAS_WIDTH.W)
+    // History the redirecting packet was predicted with
+    val ghist = UInt(GHIST_WIDTH.W)
 }
 
 class MemoryRequest extends Bundle {
     val req = Decoupled(new LoadStoreAction)
     val resp = Flipped(Decoupled(UInt(32.W)))
 }
-class BoomCoreProfileBundle extends Bundle {
+
+class MemoryResponse extends Bundle {
+    val data = UInt(32.W)
+    val tag = UInt(MEM_TAG_WIDTH.W)
+}
+
+/** Memory port with out-of-order completion
+  *
+  * Every request gets one response, which carries the request's `tag`.
+  */
+class TaggedMemoryRequest extends Bundle {
+    val req = Decoupled(new LoadStoreAction)
+    val resp = Flipped(Decoupled(new MemoryResponse))
+}
+class BoomCoreProfileBundle(dcacheWays: Int = 1) extends Bundle {
     import common.Configurables.Profiling._
     def optfield[T <: Data](cond: Boolean, gen: => T): Option[T] = {
         if (cond) Some(gen) else None
@@ -241,7 +294,28 @@ class BoomCoreProfileBundle extends Bundle {
     // Cache Stats
     val dcacheHits = optfield(CacheStats, UInt(64.W))
     val dcacheMisses = optfield(CacheStats, UInt(64.W))
+    val dcacheWayHits = optfield(CacheStats, Vec(dcacheWays, UInt(64.W)))
+    val dcacheWayRefills = optfield(CacheStats, Vec(dcacheWays, UInt(64.W)))
+    val dcachePrefetches = optfield(CacheStats, UInt(64.W))
+    val dcachePrefetchHits = optfield(CacheStats, UInt(64.W))
     val icacheHits = optfield(CacheStats, UInt(64.W))
     val icacheMisses = optfield(CacheStats, UInt(64.W))
+    val icachePrefetches = optfield(CacheStats, UInt(64.W))
+    val icacheStreamHits = optfield(CacheStats, UInt(64.W))
+    val icacheWayMispredicts = optfield(CacheStats, UInt(64.W))
+    val l2Hits = optfield(CacheStats, UInt(64.W))
+    val l2Misses = optfield(CacheStats, UInt(64.W))
+    val l2Evictions = optfield(CacheStats, UInt(64.W))
     val dramAccesses = optfield(CacheStats, UInt(64.W))
 }
+
+/** Checkpoint trigger, see `docs/dram.md`
+  *
+  * The core checkpoints once the cycle or committed instruction count reaches
+  * the given value (0 disables the trigger), then keeps running.
+  */
+class CheckpointControl extends Bundle {
+    val atCycle = Input(UInt(64.W))
+    val atInst = Input(UInt(64.W))
+    val done = Output(Bool())
+}
@@ -95,6 +95,8 @@ class BRUAdaptor extends CycleAwareModule {
     io.brUpdate.predict := s3Bits.info.predict
     io.brUpdate.predictedTarget := s3Bits.info.predictedTarget
     io.brUpdate.rasSP := s3Bits.info.rasSP
+    io.brUpdate.isCond := s3Bits.info.bruOp === BRUOpType.CBR
+    io.brUpdate.bpMeta := s3Bits.info.bpMeta
 
     val s3Mispredict = RegEnable(
       (bru.io.taken =/= s2Info.info.predict) ||
@@ -9,11 +9,26 @@ import utility.CycleAwareModule
 
 /** Load Store Adaptor
   *
-  * Bridges an Issue Buffer to the Load/Store execution unit.
+  * Bridges the load and store queues to the Load/Store execution unit.
   *
-  * Handles all load/store logic sequentially.
+  * Stores issue in order and loads issue in any order, once every older store
+  * knows its address. Up to `MEM_TAG_COUNT` memory requests can be in flight,
+  * and they complete in any order.
+  *
+  * A store issues once its base register is ready. It is broadcast in S2 with
+  * its address recorded in the store queue, which sends it to memory once the
+  * ROB has committed it and its data is known. A load whose bytes are all
+  * written by older stores in the queue takes its data from them. A load that
+  * overlaps them only partly, or needs data a store does not have yet, goes
+  * back to the load queue and issues again later.
+  *
+  * @param ldqEntries
+  *   Entries of the load queue
+  * @param stqEntries
+  *   Entries of the store queue, a power of two
   */
-class LoadStoreAdaptor extends CycleAwareModule {
+class LoadStoreAdaptor(ldqEntries: Int = 8, stqEntries: Int = 8)
+    extends CycleAwareModule {
     val io = IO(new Bundle {
         val issueIn =
             Flipped(Decoupled(new SequentialBufferEntry(new LoadStoreInfo)))
@@ -23,7 +38,7 @@ class LoadStoreAdaptor extends CycleAwareModule {
         val flush = Input(new FlushBundle)
         val robHead = Input(UInt(ROB_WIDTH.W))
 
-        val mem = new MemoryRequest
+        val mem = new TaggedMemoryRequest
         val busy =
             if (common.Configurables.Profiling.Utilization) Some(Output(Bool()))
             else None
@@ -32,44 +47,66 @@ class LoadStoreAdaptor extends CycleAwareModule {
             else None
         val lsqCount =
             if (common.Configurables.Profiling.Utilization)
-                Some(Output(UInt(log2Ceil(9).W)))
+                Some(Output(UInt(log2Ceil(ldqEntries + stqEntries + 1).W)))
+            else None
+        val idle =
+            if (common.Configurables.Simulation.checkpointing)
+                Some(Output(Bool()))
             else None
     })
 
-    // LSQ Instance
-    val lsq = Module(new SequentialIssueBuffer(new LoadStoreInfo, 16, "LSQ"))
-    io.lsqCount.foreach(_ := lsq.io.count.get)
-    lsq.io.in <> io.issueIn
-    lsq.io.broadcast := io.broadcastIn
-    lsq.io.flush := io.flush
+    // Load and Store Queues
+    val ldq = Module(new LoadQueue(ldqEntries, stqEntries))
+    val stq = Module(new StoreQueue(stqEntries, ldqEntries))
+    io.lsqCount.foreach(_ := ldq.io.count +& stq.io.count)
+
+    val dispatchIsStore = io.issueIn.bits.info.isStore
+    ldq.io.in.valid := io.issueIn.valid && !dispatchIsStore
+    ldq.io.in.bits := io.issueIn.bits
+    stq.io.in.valid := io.issueIn.valid && dispatchIsStore
+    stq.io.in.bits := io.issueIn.bits
+    io.issueIn.ready := Mux(dispatchIsStore, stq.io.in.ready, ldq.io.in.ready)
+
+    ldq.io.broadcast := io.broadcastIn
+    ldq.io.flush := io.flush
+    ldq.io.stqHead := stq.io.head
+    ldq.io.stqTail := stq.io.tail
+    ldq.io.stqAddrValid := stq.io.addrValid
+    stq.io.broadcast := io.broadcastIn
+    stq.io.flush := io.flush
+    stq.io.robHead := io.robHead
 
     // Pipeline Registers
     // Stage 1: Decode / Read PRF
     val s1Valid = RegInit(false.B)
-    val s1Bits = Reg(new SequentialBufferEntry(new LoadStoreInfo))
+    val s1Bits = Reg(new LSUIssueBundle(ldqEntries, stqEntries))
 
-    // Stage 2: Address Calc / Store Commit Check / Mem Request
+    // Stage 2: Address Calc / Store Resolve / Mem Request
     val s2Valid = RegInit(false.B)
-    val s2Bits = Reg(new SequentialBufferEntry(new LoadStoreInfo))
+    val s2Bits = Reg(new LSUIssueBundle(ldqEntries, stqEntries))
     val s2Data1 = Reg(UInt(32.W))
     val s2Data2 = Reg(UInt(32.W))
 
-    // S2 Control State Registers
-    val s2RegBroadcastDone = RegInit(false.B)
-    val s2RegCommitted = RegInit(false.B)
-
     // Stage 3: Wait for Response / Writeback
-    val s3Valid = RegInit(false.B)
-    val s3Bits = Reg(new SequentialBufferEntry(new LoadStoreInfo))
-    val s3Data = Reg(UInt(32.W))
-    val s3AddrDebug = Reg(UInt(32.W))
-    val s3WaitingResp = RegInit(false.B)
-
-    /** Fix: Track if S3 is "dead" (flushed) but waiting for Ghost Response
-      * @author
-      *   rogerflowey
-      */
-    val s3IsDead = RegInit(false.B)
+    // One slot per memory tag; the slot index is the request's tag
+    class InFlightEntry extends Bundle {
+        val bits = new SequentialBufferEntry(new LoadStoreInfo)
+        val data = UInt(32.W)
+        val addrDebug = UInt(32.W)
+        val waitingResp = Bool()
+
+        /** Fix: Track if S3 is "dead" (flushed) but waiting for Ghost
+          * Response
+          * @author
+          *   rogerflowey
+          */
+        val isDead = Bool()
+    }
+    val s3Valid = RegInit(VecInit(Seq.fill(Derived.MEM_TAG_COUNT)(false.B)))
+    val s3 = Reg(Vec(Derived.MEM_TAG_COUNT, new InFlightEntry))
+    val s3Free = s3Valid.map(!_)
+    val s3FreeTag = PriorityEncoder(s3Free)
+
     val s1Ready = Wire(Bool())
     val s2Ready = Wire(Bool())
     val s3Ready = Wire(Bool())
@@ -79,145 +116,209 @@ class LoadStoreAdaptor extends CycleAwareModule {
     io.broadcastOut <> wbArbiter.io.out
 
     // Profiling
-    io.busy.foreach(_ := s1Valid || s2Valid || s3Valid)
+    val queuesEmpty = ldq.io.count === 0.U && stq.io.count === 0.U
+    io.busy.foreach(
+      _ := s1Valid || s2Valid || s3Valid.asUInt.orR || !queuesEmpty
+    )
 
-    // Replicate commit stall logic for profiling
-    val isStoreS2_prof = s2Bits.info.isStore
-    val isCommitted_prof =
-        s2RegCommitted || (isStoreS2_prof && io.robHead === s2Bits.robTag)
-    io.stallCommit.foreach(_ := s2Valid && isStoreS2_prof && !isCommitted_prof)
+    // Committed stores may still sit in the store queue or S3 after leaving
+    // the ROB
+    io.idle.foreach(
+      _ := !s1Valid && !s2Valid && !s3Valid.asUInt.orR && queuesEmpty
+    )
+
+    // Stores stall dispatch while the store queue is full and its head is
+    // not committed
+    io.stallCommit.foreach(
+      _ := stq.io.count === stqEntries.U && !stq.io.drain.valid
+    )
 
     // Stage 1: Issue & PRF Read
-    lsq.io.out.ready := s1Ready
-    val s1Killed = io.flush.checkKilled(lsq.io.out.bits.robTag)
+    // Stores go first, since younger loads may be waiting for their address
+    stq.io.issue.ready := s1Ready
+    ldq.io.out.ready := s1Ready && !stq.io.issue.valid
+    val s1In = Mux(stq.io.issue.valid, stq.io.issue.bits, ldq.io.out.bits)
+    val s1InValid = stq.io.issue.valid || ldq.io.out.valid
+    val s1Killed = io.flush.checkKilled(s1In.bits.robTag)
 
     when(s1Ready) {
-        s1Valid := lsq.io.out.valid && !s1Killed
-        s1Bits := lsq.io.out.bits
-    }.elsewhen(io.flush.checkKilled(s1Bits.robTag)) {
+        s1Valid := s1InValid && !s1Killed
+        s1Bits := s1In
+    }.elsewhen(io.flush.checkKilled(s1Bits.bits.robTag)) {
         s1Valid := false.B
     }
 
-    io.prfRead.addr1 := s1Bits.src1
-    io.prfRead.addr2 := s1Bits.src2
+    io.prfRead.addr1 := s1Bits.bits.src1
+    io.prfRead.addr2 := s1Bits.bits.src2
 
     val s1Fire = s1Valid && s2Ready
     s1Ready := !s1Valid || s2Ready
 
     // Stage 2: Execute, Address Calc, Store Logic, Mem Request
-    val isStoreS2 = s2Bits.info.isStore
+    val s2Info = s2Bits.bits.info
+    val isStoreS2 = s2Info.isStore
     val isLoadS2 = !isStoreS2
-    val effAddr = (s2Data1.asSInt + s2Bits.info.imm.asSInt).asUInt
-
-    val s2IsHeadMatch = s2Valid && isStoreS2 && (io.robHead === s2Bits.robTag)
-    val s2CommitComplete = s2RegCommitted || s2IsHeadMatch
-    io.stallCommit.foreach(_ := s2Valid && isStoreS2 && !s2CommitComplete)
-
-    when(s2IsHeadMatch) { s2RegCommitted := true.B }
-
-    val s2Killed = io.flush.checkKilled(s2Bits.robTag) && !s2CommitComplete
-    val s2NeedBroadcast =
-        s2Valid && isStoreS2 && !s2RegBroadcastDone && !s2Killed
-
-    wbArbiter.io.in(0).valid := s2NeedBroadcast
-    wbArbiter.io.in(0).bits.pdst := s2Bits.pdst
-    wbArbiter.io.in(0).bits.robTag := s2Bits.robTag
+    val effAddr = (s2Data1.asSInt + s2Info.imm.asSInt).asUInt
+    val s2Killed = io.flush.checkKilled(s2Bits.bits.robTag)
+
+    // A store is complete once broadcast; its address goes to the store
+    // queue at the same time, and its data too if it was ready at issue
+    wbArbiter.io.in(0).valid := s2Valid && isStoreS2 && !s2Killed
+    wbArbiter.io.in(0).bits.pdst := s2Bits.bits.pdst
+    wbArbiter.io.in(0).bits.robTag := s2Bits.bits.robTag
     wbArbiter.io.in(0).bits.data := 0.U
     wbArbiter.io.in(0).bits.writeEn := false.B
 
-    val s2IsBroadcastFiring = wbArbiter.io.in(0).fire
-    val s2BroadcastComplete = s2RegBroadcastDone || s2IsBroadcastFiring
-
-    when(s2IsBroadcastFiring) { s2RegBroadcastDone := true.B }
+    val s2StoreFire = wbArbiter.io.in(0).fire
+    stq.io.resolve.valid := s2StoreFire
+    stq.io.resolve.bits.ptr := s2Bits.stqPtr
+    stq.io.resolve.bits.addr := effAddr
+    stq.io.resolve.bits.data := s2Data2
+    stq.io.resolve.bits.dataValid := s2Bits.bits.src2Ready
+
+    // Store-to-Load Forwarding
+    stq.io.fwd.addr := effAddr
+    stq.io.fwd.info := s2Info
+    stq.io.fwd.stqPtr := s2Bits.stqPtr
+    val loadMask = StoreQueue.laneMask(s2Info, effAddr)
+    val fwdCovered = stq.io.fwd.mask & loadMask
+    val fwdHit = fwdCovered === loadMask
+    // Bytes whose store has no data yet cannot be forwarded either
+    val fwdPartial = fwdCovered =/= 0.U && !fwdHit ||
+        (stq.io.fwd.pending & loadMask) =/= 0.U
+    val fwdWord = stq.io.fwd.data
+
+    // MMIO loads are not forwarded and wait for every older store
+    val s2IsMMIO = effAddr(31) === 1.U
+    val s2LoadLive = s2Valid && isLoadS2 && !s2Killed
+    val s2LoadReplay =
+        s2LoadLive && Mux(s2IsMMIO, stq.io.fwd.older, fwdPartial)
+    val s2LoadFwd = s2LoadLive && !s2IsMMIO && fwdHit
+    val s2LoadReq = s2LoadLive && !s2LoadFwd && !s2LoadReplay
+
+    // The memory port is shared by S2 loads and the store queue drain.
+    // Loads go first unless the store queue is full.
+    val stqFull = stq.io.count === stqEntries.U
+    val drainValid = stq.io.drain.valid
+    val drainEntry = stq.io.drain.bits
+    val s2UsesPort = (s2LoadReq || s2LoadFwd) && (!stqFull || !drainValid)
+
+    io.mem.req.valid := s3Ready && Mux(s2UsesPort, s2LoadReq, drainValid)
+    io.mem.req.bits.addr := Mux(s2UsesPort, effAddr, drainEntry.addr)
+    io.mem.req.bits.data := drainEntry.data
+    io.mem.req.bits.isLoad := s2UsesPort
+    io.mem.req.bits.opWidth := Mux(
+      s2UsesPort,
+      s2Info.opWidth,
+      drainEntry.bits.info.opWidth
+    )
+    io.mem.req.bits.isUnsigned := Mux(
+      s2UsesPort,
+      s2Info.isUnsigned,
+      drainEntry.bits.info.isUnsigned
+    )
+    io.mem.req.bits.targetReg := Mux(
+      s2UsesPort,
+      s2Bits.bits.pdst,
+      drainEntry.bits.pdst
+    )
+    io.mem.req.bits.tag := s3FreeTag
+    stq.io.drain.ready := s3Ready && !s2UsesPort && io.mem.req.ready
 
-    val s2CanIssueStore = s2CommitComplete && s2BroadcastComplete
-    val s2MemReqValid = s2Valid && !s2Killed && (isLoadS2 || s2CanIssueStore)
+    val s2FwdFire = s2UsesPort && s2LoadFwd && s3Ready
+    val s2LoadFire = s2UsesPort && io.mem.req.fire
+    val drainFire = stq.io.drain.fire
 
-    io.mem.req.valid := s2MemReqValid && s3Ready
-    io.mem.req.bits.addr := effAddr
-    io.mem.req.bits.data := s2Data2
-    io.mem.req.bits.isLoad := isLoadS2
-    io.mem.req.bits.opWidth := s2Bits.info.opWidth
-    io.mem.req.bits.isUnsigned := s2Bits.info.isUnsigned
-    io.mem.req.bits.targetReg := s2Bits.pdst
+    ldq.io.done.valid := s2LoadFire || s2FwdFire
+    ldq.io.done.bits := s2Bits.ldqIdx
+    ldq.io.replay.valid := s2LoadReplay
+    ldq.io.replay.bits := s2Bits.ldqIdx
 
-    val s2Fire = io.mem.req.fire
+    val s2Fire = s2StoreFire || s2LoadFire || s2FwdFire || s2LoadReplay
     s2Ready := !s2Valid || s2Fire || s2Killed
 
     when(s2Ready) {
-        val validNext = s1Fire && !io.flush.checkKilled(s1Bits.robTag)
+        val validNext = s1Fire && !io.flush.checkKilled(s1Bits.bits.robTag)
         s2Valid := validNext
         s2Bits := s1Bits
         s2Data1 := io.prfRead.data1
         s2Data2 := io.prfRead.data2
-        s2RegCommitted := false.B
-        s2RegBroadcastDone := false.B
     }.elsewhen(s2Killed) {
         s2Valid := false.B
     }
 
     // Stage 3: Variable Latency Response & Writeback
+    // S2 may issue while any slot is free
+    s3Ready := s3Free.reduce(_ || _)
+
+    for (i <- 0 until Derived.MEM_TAG_COUNT) {
+        val e = s3(i)
+        val isLoad = !e.bits.info.isStore
+
+        // Stage 3.1: Detect Flush (fix bfd662b4dbc5cb5c67767885417a3e171009ee94)
+        // If flushed, do not clear the slot immediately if we are waiting for a response.
+        // Instead, mark as "Dead".
+        when(s3Valid(i) && io.flush.checkKilled(e.bits.robTag) && isLoad) {
+            e.isDead := true.B
+        }
 
-    val isStoreS3 = s3Bits.info.isStore
-    val isLoadS3 = !isStoreS3
-
-    // Stage 3.1: Detect Flush (fix bfd662b4dbc5cb5c67767885417a3e171009ee94)
-    // If flushed, do not clear s3Valid immediately if we are waiting for a response.
-    // Instead, mark as "Dead".
-    val s3FlushHit = io.flush.checkKilled(s3Bits.robTag) && isLoadS3
-    when(s3FlushHit) {
-        s3IsDead := true.B
-    }
-
-    // Stage 3.2: Handle Response
-    when(io.mem.resp.valid) {
-        s3Data := io.mem.resp.bits
-        s3WaitingResp := false.B
+        // Stage 3.2: Handle Response
+        when(io.mem.resp.valid && io.mem.resp.bits.tag === i.U) {
+            e.data := io.mem.resp.bits.data
+            e.waitingResp := false.B
+        }
     }
     io.mem.resp.ready := true.B
 
     // Stage 3.3: Completion Logic
-    val s3IsPending = s3WaitingResp
-    val s3MemDone = s3Valid && !s3IsPending
+    val s3FlushHit = VecInit(
+      s3.map(e => io.flush.checkKilled(e.bits.robTag) && !e.bits.info.isStore)
+    )
+    val s3MemDone = VecInit(
+      s3.zip(s3Valid).map { case (e, v) => v && !e.waitingResp }
+    )
+    val s3CanWriteback = VecInit(
+      Seq.tabulate(Derived.MEM_TAG_COUNT)(i =>
+          s3MemDone(i) && !s3(i).bits.info.isStore && !s3(i).isDead &&
+              !s3FlushHit(i)
+      )
+    )
 
     // Stage 3.4: Writeback Arbiter (Priority 1: Loads)
     // Only request writeback if done, is Load, not marked dead, and not currently being flushed.
-    wbArbiter.io
-        .in(1)
-        .valid := s3MemDone && isLoadS3 && !s3IsDead && !s3FlushHit
-    wbArbiter.io.in(1).bits.pdst := s3Bits.pdst
-    wbArbiter.io.in(1).bits.robTag := s3Bits.robTag
-    wbArbiter.io.in(1).bits.data := s3Data
+    val s3WbTag = PriorityEncoder(s3CanWriteback)
+    wbArbiter.io.in(1).valid := s3CanWriteback.asUInt.orR
+    wbArbiter.io.in(1).bits.pdst := s3(s3WbTag).bits.pdst
+    wbArbiter.io.in(1).bits.robTag := s3(s3WbTag).bits.robTag
+    wbArbiter.io.in(1).bits.data := s3(s3WbTag).data
     wbArbiter.io.in(1).bits.writeEn := true.B
 
     // Stage 3.5: Fire/Drain Logic
-    // We can empty S3 (Fire) if:
-    // A. Not waiting for a response (s3IsPending is false).
-    // B. It is either:
+    // A slot is freed once its response has arrived and it is either:
     //    1. A Load that finished Writeback.
-    //    2. A Store that finished (ACK received).
+    //    2. A Store (ACK received).
     //    3. A Load that was Killed/Dead (just drop it).
+    for (i <- 0 until Derived.MEM_TAG_COUNT) {
+        val e = s3(i)
+        val isStore = e.bits.info.isStore
+        val s3Fire = s3MemDone(i) && (
+          (wbArbiter.io.in(1).fire && s3WbTag === i.U) || // Normal Load
+              isStore || // Normal Store
+              e.isDead || s3FlushHit(i) // Killed Load (Drain)
+        )
+        when(s3Fire) { s3Valid(i) := false.B }
+    }
 
-    val s3IsDeadOrFlushed = s3IsDead || s3FlushHit
-
-    val s3Fire = !s3IsPending && (
-      (s3MemDone && isLoadS3 && wbArbiter.io.in(1).ready) || // Normal Load
-          (s3MemDone && isStoreS3) || // Normal Store
-          (s3Valid && isLoadS3 && s3IsDeadOrFlushed) // Killed Load (Drain)
-    )
-
-    s3Ready := !s3Valid || s3Fire
-
-    when(s3Ready) {
-        val incomingValid = s2Fire
-
-        s3Valid := incomingValid
-        s3Bits := s2Bits
-        s3AddrDebug := effAddr
-        s3WaitingResp := incomingValid
+    when(io.mem.req.fire || s2FwdFire) {
+        val e = s3(s3FreeTag)
+        s3Valid(s3FreeTag) := true.B
+        e.bits := Mux(drainFire, drainEntry.bits, s2Bits.bits)
+        e.addrDebug := io.mem.req.bits.addr
+        e.waitingResp := !s2FwdFire
+        e.data := formatLoad(s2Info, effAddr, fwdWord)
 
         // Reset Dead status for the new instruction
-        s3IsDead := false.B
+        e.isDead := false.B
     }
 
     // Debug Printing
@@ -227,13 +328,42 @@ class LoadStoreAdaptor extends CycleAwareModule {
               p"STORE_REQ: Addr=0x${Hexadecimal(io.mem.req.bits.addr)} Data=0x${Hexadecimal(io.mem.req.bits.data)}\n"
             )
         }
+        when(s2FwdFire) {
+            printf(
+              p"LOAD_FWD: Addr=0x${Hexadecimal(effAddr)} Data=0x${Hexadecimal(formatLoad(s2Info, effAddr, fwdWord))}\n"
+            )
+        }
         when(wbArbiter.io.in(1).fire) {
             printf(
-              p"LOAD_WB: Addr=0x${Hexadecimal(s3AddrDebug)} Data=0x${Hexadecimal(wbArbiter.io.in(1).bits.data)}\n"
+              p"LOAD_WB: Addr=0x${Hexadecimal(s3(s3WbTag).addrDebug)} Data=0x${Hexadecimal(wbArbiter.io.in(1).bits.data)}\n"
             )
         }
-        when(s3MemDone && isStoreS3 && s3Ready) {
-            printf(p"STORE_ACK: Addr=0x${Hexadecimal(s3AddrDebug)}\n")
+        for (i <- 0 until Derived.MEM_TAG_COUNT) {
+            when(s3MemDone(i) && s3(i).bits.info.isStore) {
+                printf(
+                  p"STORE_ACK: Addr=0x${Hexadecimal(s3(i).addrDebug)}\n"
+                )
+            }
         }
     }
+
+    // Same alignment and extension as `MemorySubsystem` applies to responses
+    private def formatLoad(info: LoadStoreInfo, addr: UInt, word: UInt) = {
+        val rbyte = (word >> (addr(1, 0) * 8.U))(7, 0)
+        val rhalf = (word >> (addr(1) << 4))(15, 0)
+        MuxLookup(info.opWidth, word)(
+          Seq(
+            MemOpWidth.BYTE -> Mux(
+              info.isUnsigned,
+              rbyte,
+              Cat(Fill(24, rbyte(7)), rbyte)
+            ),
+            MemOpWidth.HALFWORD -> Mux(
+              info.isUnsigned,
+              rhalf,
+              Cat(Fill(16, rhalf(15)), rhalf)
+            )
+          )
+        )
+    }
 }
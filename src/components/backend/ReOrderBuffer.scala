@@ -49,6 +49,9 @@ class ReOrderBuffer extends CycleAwareModule {
             if (common.Configurables.Profiling.Utilization)
                 Some(Output(UInt((ROB_WIDTH + 1).W)))
             else None
+        val empty =
+            if (Configurables.Simulation.checkpointing) Some(Output(Bool()))
+            else None
     })
 
     private val entries = Derived.ROB_COUNT
@@ -87,6 +90,7 @@ class ReOrderBuffer extends CycleAwareModule {
     val ptrMatch = head === tail
     val isFull = ptrMatch && maybeFull
     val isEmpty = ptrMatch && !maybeFull
+    io.empty.foreach(_ := isEmpty && !isRollingBack)
 
     io.count.foreach { c =>
         c := Mux(
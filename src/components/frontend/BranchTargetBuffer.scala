@@ -2,74 +2,177 @@ package components.frontend
 
 import chisel3._
 import chisel3.util._
+import common.Configurables._
+import common.Configurables.Derived._
+import components.memory.{CacheReplacement, ReplacementPolicy}
+
+/** Branch Target Buffer parameters
+  *
+  * @param nSetsWidth
+  *   log2 of the number of sets; a set covers one fetch packet address
+  * @param nWays
+  *   Ways per slot, a power of two
+  * @param tagWidth
+  *   Bits of the partial tag, folded from the address bits above the index
+  * @param replacement
+  *   Replacement policy within a set
+  */
+case class BTBConfig(
+    nSetsWidth: Int = 4,
+    nWays: Int = 4,
+    tagWidth: Int = 10,
+    replacement: ReplacementPolicy = ReplacementPolicy.PLRU
+) {
+    def nEntries: Int = (FETCH_PACKET_SIZE * nWays) << nSetsWidth
+}
 
 /** Branch Target Buffer
   *
-  * A simple Branch Target Buffer (BTB) implementation that stores branch target
-  * addresses for taken branches. Uses a 2-bit saturating counter for
-  * prediction.
+  * A set-associative Branch Target Buffer (BTB) that stores branch target
+  * addresses for taken branches. Direction comes from the direction predictor:
+  * a hit on a jump is always taken, a hit on a conditional branch is taken when
+  * the predictor says so.
+  *
+  * A lookup returns the prediction of every slot in the fetch packet holding
+  * `pc`. Entries are banked by slot, so one read serves the whole packet. Each
+  * slot of a set has `nWays` ways with their own partial tags and replacement
+  * state.
+  *
+  * Entries are installed by taken branch updates from the BRU, and by direct
+  * jumps found at decode through `fill`, so a `JAL` does not have to
+  * mispredict before it is predicted. An update has priority over a fill in
+  * the same cycle.
+  *
+  * @param conf
+  *   BTB geometry
   */
-class BranchTargetBuffer extends Module {
+class BranchTargetBuffer(conf: BTBConfig = BranchTargetBuffer.defaultConf)
+    extends Module {
+    require(isPow2(conf.nWays), "nWays must be a power of two")
     // IO Definition
     val io = IO(new Bundle {
         // Predictor interface
         val pc = Input(UInt(32.W))
-        val target = Output(Valid(UInt(32.W)))
+        val target = Output(Vec(FETCH_PACKET_SIZE, Valid(UInt(32.W))))
+        val isCond = Output(Vec(FETCH_PACKET_SIZE, Bool()))
 
         // Update interface
         val update = Input(Valid(new Bundle {
             val pc = UInt(32.W)
             val target = UInt(32.W)
             val taken = Bool()
+            val isCond = Bool()
             val mispredict = Bool()
         }))
+
+        // Direct jumps from decode
+        val fill = Input(Valid(new Bundle {
+            val pc = UInt(32.W)
+            val target = UInt(32.W)
+        }))
     })
 
-    // Internal BRB Entry Definition
+    // Internal BTB Entry Definition
     class BTBEntry extends Bundle {
-        val tag = UInt(25.W)
         val target = UInt(32.W)
+        val isCond = Bool()
     }
 
-    // Storage
-    val buffer = SyncReadMem(32, new BTBEntry)
-    val valids = RegInit(0.U(32.W))
-    val counters = RegInit(VecInit(Seq.fill(32)(0.U(2.W))))
+    val nSets = 1 << conf.nSetsWidth
+    val nWays = conf.nWays
+    val nBanks = FETCH_PACKET_SIZE * nWays
+    val offsetWidth = FETCH_PACKET_WIDTH + 2
+
+    // Storage: one row per set, `nWays` banks per slot (bank = slot * nWays
+    // + way). Targets live in memory; tags and valid bits in registers, so an
+    // update can find its way without a read.
+    val buffer = SyncReadMem(nSets, Vec(nBanks, new BTBEntry))
+    val tags = Reg(Vec(nSets, Vec(nBanks, UInt(conf.tagWidth.W))))
+    val valids = RegInit(VecInit(Seq.fill(nSets)(0.U(nBanks.W))))
+    // Replacement state per (set, slot)
+    val repl = Module(
+      new CacheReplacement(nSets * FETCH_PACKET_SIZE, nWays, conf.replacement)
+    )
 
     // Addresses
-    val index = io.pc(6, 2)
-    val tag = io.pc(31, 7)
+    def setIndex(pc: UInt) =
+        pc(offsetWidth + conf.nSetsWidth - 1, offsetWidth)
+    def partialTag(pc: UInt) = {
+        val high = pc(31, offsetWidth + conf.nSetsWidth)
+        val chunks = (0 until high.getWidth by conf.tagWidth).map { lo =>
+            high((lo + conf.tagWidth - 1) min (high.getWidth - 1), lo)
+        }
+        chunks.reduce(_ ^ _)(conf.tagWidth - 1, 0)
+    }
 
     // Read Pipeline Regs
-    val validReg = RegNext(valids(index))
-    val tagReg = RegNext(tag)
-    val countReg = RegNext(counters(index))
-    val entry = buffer.read(index)
+    val set = setIndex(io.pc)
+    val setReg = RegNext(set)
+    val tagReg = RegNext(partialTag(io.pc))
+    val entries = buffer.read(set)
 
     // Prediction
-    when(validReg && entry.tag === tagReg && countReg(1)) {
-        io.target.valid := true.B
-        io.target.bits := entry.target
-    }.otherwise {
-        io.target.valid := false.B
-        io.target.bits := 0.U
+    for (s <- 0 until FETCH_PACKET_SIZE) {
+        val hits = VecInit(Seq.tabulate(nWays) { w =>
+            val b = s * nWays + w
+            valids(setReg)(b) && tags(setReg)(b) === tagReg
+        })
+        val hitEntry = Mux1H(hits, entries.slice(s * nWays, (s + 1) * nWays))
+        io.target(s).valid := hits.asUInt.orR
+        io.target(s).bits := Mux(hits.asUInt.orR, hitEntry.target, 0.U)
+        io.isCond(s) := hitEntry.isCond
     }
 
-    // Update
-    when(io.update.valid) {
-        val updIndex = io.update.bits.pc(6, 2)
-        val updTag = io.update.bits.pc(31, 7)
+    // Update: taken branches and jumps install their target, direct jumps
+    // from decode fill in when no update is written
+    val useUpdate = io.update.valid && io.update.bits.taken
+    val wen = useUpdate || io.fill.valid
+    val wPC = Mux(useUpdate, io.update.bits.pc, io.fill.bits.pc)
+    val wSet = setIndex(wPC)
+    val wTag = partialTag(wPC)
+    val wSlot = wPC(offsetWidth - 1, 2)
+
+    // An entry already holding this branch is reused, then an invalid way,
+    // then the replacement victim
+    val setValids = valids(wSet)
+    val slotValids =
+        VecInit(Seq.tabulate(nWays)(w => setValids(wSlot * nWays.U + w.U)))
+    val slotHits = VecInit(Seq.tabulate(nWays) { w =>
+        slotValids(w) && tags(wSet)(wSlot * nWays.U + w.U) === wTag
+    })
+    repl.io.set := Cat(wSet, wSlot)
+    val wWay = Mux(
+      slotHits.asUInt.orR,
+      OHToUInt(slotHits),
+      Mux(
+        slotValids.asUInt.andR,
+        repl.io.victim,
+        PriorityEncoder(slotValids.map(!_))
+      )
+    )
+    val wBank = wSlot * nWays.U + wWay
+
+    repl.io.touch.valid := wen
+    repl.io.touch.bits.set := Cat(wSet, wSlot)
+    repl.io.touch.bits.way := wWay
+
+    when(wen) {
         val newEntry = Wire(new BTBEntry)
-        newEntry.tag := updTag
-        newEntry.target := io.update.bits.target
-
-        val cnt = counters(updIndex)
-        when(io.update.bits.taken) {
-            buffer.write(updIndex, newEntry)
-            valids := valids | (1.U << updIndex)
-            counters(updIndex) := Mux(cnt === 3.U, 3.U, cnt + 1.U)
-        }.otherwise {
-            counters(updIndex) := Mux(cnt === 0.U, 0.U, cnt - 1.U)
-        }
+        newEntry.target :=
+            Mux(useUpdate, io.update.bits.target, io.fill.bits.target)
+        newEntry.isCond := useUpdate && io.update.bits.isCond
+
+        buffer.write(
+          wSet,
+          VecInit(Seq.fill(nBanks)(newEntry)),
+          UIntToOH(wBank, nBanks).asBools
+        )
+        tags(wSet)(wBank) := wTag
+        valids(wSet) := setValids | UIntToOH(wBank, nBanks)
     }
 }
+
+object BranchTargetBuffer {
+    // 16 sets x 4 slots x 4 ways = 256 entries, 10-bit partial tags
+    val defaultConf = BTBConfig()
+}
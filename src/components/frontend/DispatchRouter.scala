@@ -131,11 +131,12 @@ class DispatchRouter extends Module {
     io.bruIB.bits.info.predict := inst.predict
     io.bruIB.bits.info.predictedTarget := inst.predictedTarget
     io.bruIB.bits.info.rasSP := rasSP // Use RAS from Queue
+    io.bruIB.bits.info.bpMeta := inst.bpMeta
     if (Configurables.Elaboration.pcInIssueBuffer) {
         io.bruIB.bits.pc.get := inst.pc
     }
 
-    // LSU IB Enqueue (Sequential)
+    // LSU Enqueue (split into the load and store queues by the LSU)
     io.lsuIB.valid := valid && isLSU && readyForDispatch
     io.lsuIB.bits.robTag := robTag
     io.lsuIB.bits.pdst := inst.pdst
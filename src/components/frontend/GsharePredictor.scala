@@ -0,0 +1,74 @@
+package components.frontend
+
+import chisel3._
+import chisel3.util._
+import common._
+import common.Configurables._
+import common.Configurables.Derived._
+
+/** Gshare Direction Predictor
+  *
+  * A table of 2-bit saturating counters indexed by the fetch packet address
+  * XOR the global history, banked by slot like the BTB, so one read serves
+  * the whole packet. A slot is predicted taken when its counter is 2 or 3.
+  *
+  * The history is kept by the fetcher. The counter read for an instruction
+  * travels with it and comes back with its branch update, so training needs
+  * no second read of the table.
+  */
+class GsharePredictor extends Module {
+    val io = IO(new Bundle {
+        // Lookup interface, answered the next cycle
+        val pc = Input(UInt(32.W))
+        val ghist = Input(UInt(GHIST_WIDTH.W))
+        val counters = Output(Vec(FETCH_PACKET_SIZE, UInt(2.W)))
+
+        // Update interface, for conditional branches
+        val update = Input(Valid(new Bundle {
+            val pc = UInt(32.W)
+            val meta = new BranchPredictorMeta
+            val taken = Bool()
+        }))
+    })
+
+    val nRows = 1 << GHIST_WIDTH
+    // Counters start weakly not taken
+    val table = SyncReadMem(nRows, Vec(FETCH_PACKET_SIZE, UInt(2.W)))
+    val written = RegInit(0.U(nRows.W))
+
+    def rowIndex(pc: UInt, ghist: UInt) =
+        (pc(GHIST_WIDTH + FETCH_PACKET_WIDTH + 1, FETCH_PACKET_WIDTH + 2) ^
+            ghist)(GHIST_WIDTH - 1, 0)
+
+    // Lookup
+    val row = rowIndex(io.pc, io.ghist)
+    val rowWritten = RegNext(written(row))
+    val entries = table.read(row)
+    for (s <- 0 until FETCH_PACKET_SIZE) {
+        io.counters(s) := Mux(rowWritten, entries(s), 1.U)
+    }
+
+    // Update
+    when(io.update.valid) {
+        val updRow = rowIndex(io.update.bits.pc, io.update.bits.meta.ghist)
+        val updSlot = io.update.bits.pc(FETCH_PACKET_WIDTH + 1, 2)
+        val cnt = io.update.bits.meta.counter
+        val newCnt = Mux(
+          io.update.bits.taken,
+          Mux(cnt === 3.U, 3.U, cnt + 1.U),
+          Mux(cnt === 0.U, 0.U, cnt - 1.U)
+        )
+        // A row written for the first time has its other slots reset
+        val isNew = !written(updRow)
+        val mask = Mux(
+          isNew,
+          Fill(FETCH_PACKET_SIZE, 1.U(1.W)),
+          UIntToOH(updSlot, FETCH_PACKET_SIZE)
+        )
+        val data = VecInit(Seq.tabulate(FETCH_PACKET_SIZE)(s =>
+            Mux(s.U === updSlot, newCnt, 1.U(2.W))
+        ))
+        table.write(updRow, data, mask.asBools)
+        written := written | UIntToOH(updRow, nRows)
+    }
+}
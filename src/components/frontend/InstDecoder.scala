@@ -221,6 +221,7 @@ class InstDecoder extends CycleAwareModule {
     io.out.bits.pc := pc
     io.out.bits.predict := io.in.bits.predict
     io.out.bits.predictedTarget := io.in.bits.predictedTarget
+    io.out.bits.bpMeta := io.in.bits.bpMeta
     io.out.bits.lrs1 := lrs1
     io.out.bits.lrs2 := lrs2
     io.out.bits.ldst := ldst
@@ -3,28 +3,72 @@ package components.frontend
 import chisel3._
 import chisel3.util._
 import common._
+import common.Configurables._
+import common.Configurables.Derived._
 import utility.CycleAwareModule
 
+/** Fetch Target
+  *
+  * One predicted fetch packet, queued between the predictor and the I-cache.
+  */
+class FetchTarget extends Bundle {
+    val pc = UInt(32.W) // Address the packet is fetched from
+    val mask = UInt(FETCH_PACKET_SIZE.W) // Slots from `pc` to the cut
+    val predict = Bool()
+    val predictedTarget = UInt(32.W)
+    val ghist = UInt(GHIST_WIDTH.W)
+    val counters = Vec(FETCH_PACKET_SIZE, UInt(2.W))
+}
+
 /** Instruction Fetcher
   *
-  * Fetches instructions from the instruction cache, handles PC updates, and
-  * interfaces with the Branch Target Buffer (BTB) for branch prediction.
+  * A decoupled frontend: the branch predictor runs ahead of the instruction
+  * cache and fills a fetch target queue (FTQ), which the I-cache side drains
+  * on its own.
+  *
+  * The predictor looks up the BTB and the direction predictor for the aligned
+  * packet of `FETCH_PACKET_SIZE` instructions holding its PC. The packet ends
+  * at the first slot predicted taken: a BTB hit on a jump, or on a conditional
+  * branch whose direction counter is set. The next prediction goes to its
+  * target; otherwise it goes to the next packet. Each prediction is queued as
+  * a `FetchTarget`, and the predictor only stalls when the FTQ is full, so it
+  * keeps going through I-cache misses.
+  *
+  * The fetch side sends the head of the FTQ to the I-cache and pairs the
+  * returned instructions with the prediction. On a miss or a full decode
+  * queue it requests the same target again.
+  *
+  * The global history gets one bit per fetch packet, set if the packet ends
+  * in a taken prediction. It is updated speculatively when the packet enters
+  * the FTQ and repaired by the backend on a misprediction. A redirect clears
+  * the FTQ and both pipelines.
+  *
+  * @param ftqEntries
+  *   Number of predicted packets the predictor may run ahead
   */
-class InstFetcher extends CycleAwareModule {
+class InstFetcher(ftqEntries: Int = 8) extends CycleAwareModule {
     // IO Definition
     val io = IO(new Bundle {
         val pcOverwrite =
             Input(Valid(UInt(32.W))) // Overwrite PC when misprediction occurs
-        val instAddr = Output(UInt(32.W)) // Debug/Trace output
-        val btbResult = Input(Valid(UInt(32.W))) // Branch Target from BTB
+        val instAddr = Output(UInt(32.W)) // Predictor lookup address
+        val btbResult = Input(
+          Vec(FETCH_PACKET_SIZE, Valid(UInt(32.W)))
+        ) // Branch Targets from BTB, one per slot
+        val btbIsCond = Input(Vec(FETCH_PACKET_SIZE, Bool()))
+
+        // Direction predictor: lookup history and per-slot counters
+        val ghist = Output(UInt(GHIST_WIDTH.W))
+        val dirCounters = Input(Vec(FETCH_PACKET_SIZE, UInt(2.W)))
+        val histRepair = Input(Valid(UInt(GHIST_WIDTH.W)))
 
         val icache = new Bundle {
             val req = Decoupled(UInt(32.W)) // We send Address
             val resp =
-                Flipped(Decoupled(UInt(32.W))) // We receive Data + Valid (Hit)
+                Flipped(Decoupled(new ICacheResp)) // We receive Packet + Valid (Hit)
         }
 
-        val ifOut = Decoupled(new FetchToDecodeBundle())
+        val ifOut = Decoupled(new FetchPacket())
 
         // Used for profiling
         val busy =
@@ -35,80 +79,145 @@ class InstFetcher extends CycleAwareModule {
             else None
     })
 
-    val pc = RegInit(0.U(32.W))
+    val redirect = io.pcOverwrite.valid
 
-    // Forward declaration: Stage 2 states
-    val s2Valid = RegInit(false.B)
-    val s2PC = Reg(UInt(32.W))
-    val s2Predict = Reg(Bool())
-    val s2Target = Reg(UInt(32.W))
+    // Fetch Target Queue, cleared on a redirect
+    val ftq = Module(new Queue(new FetchTarget, ftqEntries))
+    ftq.reset := reset.asBool || redirect
 
-    io.busy.foreach(_ := s2Valid)
-    io.stallBuffer.foreach(_ := s2Valid && !io.ifOut.ready)
+    // -----------------------------------------------------------
+    // Predictor: lookup (P1), then prediction and enqueue (P2)
+    // -----------------------------------------------------------
 
-    val s2Fire = s2Valid && io.ifOut.ready && io.icache.resp.valid
-    val s1Ready = !s2Valid || s2Fire || io.pcOverwrite.valid
+    val bpPC = RegInit(0.U(32.W))
+    val p2Valid = RegInit(false.B)
+    val p2PC = Reg(UInt(32.W))
+    val p2Hist = Reg(UInt(GHIST_WIDTH.W))
 
-    // Stage 1: PC Generation & Request
-    // fetchAddr is what is sent to ICache and BTB
-    val fetchAddr = Wire(UInt(32.W))
-    when(io.pcOverwrite.valid) {
-        fetchAddr := io.pcOverwrite.bits
-    }.elsewhen(s2Valid && !s2Fire) {
-        fetchAddr := s2PC // Hold target pc if ifOut stall or cache miss
-    }.elsewhen(io.btbResult.valid) {
-        fetchAddr := io.btbResult.bits
+    val p2Fire = ftq.io.enq.fire
+
+    // Slots from the PC to the end of the packet
+    val p2Mask =
+        (~0.U(FETCH_PACKET_SIZE.W) << p2PC(FETCH_PACKET_WIDTH + 1, 2))(
+          FETCH_PACKET_SIZE - 1,
+          0
+        )
+
+    // The first predicted-taken slot at or after the PC ends the packet
+    val takenVec = VecInit(
+      Seq.tabulate(FETCH_PACKET_SIZE)(i =>
+          p2Mask(i) && io.btbResult(i).valid &&
+              (!io.btbIsCond(i) || io.dirCounters(i)(1))
+      )
+    )
+    val p2Taken = p2Valid && takenVec.asUInt.orR
+    val takenSlot = PriorityEncoder(takenVec)
+    val p2Target = io.btbResult(takenSlot).bits
+    val slotsUpTo = VecInit(
+      Seq.tabulate(FETCH_PACKET_SIZE)(i =>
+          ((1 << (i + 1)) - 1).U(FETCH_PACKET_SIZE.W)
+      )
+    )
+
+    // lookupAddr is what is sent to the BTB and the direction predictor
+    val lookupAddr = Wire(UInt(32.W))
+    when(redirect) {
+        lookupAddr := io.pcOverwrite.bits
+    }.elsewhen(p2Valid && !p2Fire) {
+        lookupAddr := p2PC // Hold the packet while the FTQ is full
+    }.elsewhen(p2Taken) {
+        lookupAddr := p2Target
     }.otherwise {
-        fetchAddr := pc
+        lookupAddr := bpPC
     }
-    io.instAddr := fetchAddr
+    io.instAddr := lookupAddr
+
+    // Global History: the lookup sees the bit of the packet entering the FTQ
+    val ghist = RegInit(0.U(GHIST_WIDTH.W))
+    val histAfterP2 = Cat(ghist, p2Taken)(GHIST_WIDTH - 1, 0)
+    val lookupHist = Mux(
+      io.histRepair.valid,
+      io.histRepair.bits,
+      Mux(p2Fire, histAfterP2, ghist)
+    )
+    io.ghist := lookupHist
+    ghist := lookupHist
+
+    // Next PC: start of the packet after lookupAddr
+    val p1Fire = !p2Valid || p2Fire || redirect
+    when(p1Fire) {
+        bpPC := Cat(
+          lookupAddr(31, FETCH_PACKET_WIDTH + 2) + 1.U,
+          0.U((FETCH_PACKET_WIDTH + 2).W)
+        )
+        p2Valid := true.B
+        p2PC := lookupAddr
+        p2Hist := lookupHist
+    }
+
+    ftq.io.enq.valid := p2Valid && !redirect
+    ftq.io.enq.bits.pc := p2PC
+    ftq.io.enq.bits.mask := Mux(p2Taken, p2Mask & slotsUpTo(takenSlot), p2Mask)
+    ftq.io.enq.bits.predict := p2Taken
+    ftq.io.enq.bits.predictedTarget := p2Target
+    ftq.io.enq.bits.ghist := p2Hist
+    ftq.io.enq.bits.counters := io.dirCounters
+
+    // -----------------------------------------------------------
+    // Fetch: I-cache request (F1), then response (F2)
+    // -----------------------------------------------------------
+
+    val f2Valid = RegInit(false.B)
+    val f2 = Reg(new FetchTarget)
+
+    io.busy.foreach(_ := f2Valid)
+    io.stallBuffer.foreach(_ := f2Valid && !io.ifOut.ready)
+
+    val f2Fire = f2Valid && io.ifOut.ready && io.icache.resp.valid
+    val f2Hold = f2Valid && !f2Fire
 
-    io.icache.req.valid := !reset.asBool
-    io.icache.req.bits := fetchAddr
+    // Take the next target once F2 is free
+    ftq.io.deq.ready := !f2Hold && !redirect
+    val f1Fire = ftq.io.deq.fire
+
+    io.icache.req.valid := (f2Hold || ftq.io.deq.valid) && !redirect
+    io.icache.req.bits := Mux(f2Hold, f2.pc, ftq.io.deq.bits.pc)
 
     /*
      * @note
      *   Ignore icache.req.ready here. If cache is not ready (refilling),
-     *   it won't return valid data, s2Fire will be false, and we naturally retry this fetchAddr next cycle).
+     *   it won't return valid data, f2Fire will be false, and we naturally retry f2.pc next cycle).
      */
 
-    // Update PC for next cycle
-    val nextPC = Wire(UInt(32.W))
-    when(io.pcOverwrite.valid) {
-        nextPC := io.pcOverwrite.bits + 4.U
-    }.elsewhen(io.btbResult.valid) {
-        nextPC := io.btbResult.bits + 4.U
-    }.elsewhen(s1Ready) {
-        nextPC := pc + 4.U
-    }.otherwise {
-        nextPC := pc
-    }
-    pc := nextPC
-
-    // Stage 2: Output Logic
-    val s1Fire = s1Ready
-
-    when(s1Fire) {
-        s2Valid := true.B
-        s2PC := fetchAddr
-    }.elsewhen(s2Fire) {
-        s2Valid := false.B
+    when(redirect) {
+        f2Valid := false.B
+    }.elsewhen(f1Fire) {
+        f2Valid := true.B
+        f2 := ftq.io.deq.bits
+    }.elsewhen(f2Fire) {
+        f2Valid := false.B
     }
 
     // Output valid only on Cache hit
-    io.ifOut.valid := s2Valid && !io.pcOverwrite.valid && io.icache.resp.valid
+    io.ifOut.valid := f2Valid && !redirect && io.icache.resp.valid
 
-    io.ifOut.bits.pc := s2PC
-    io.ifOut.bits.inst := io.icache.resp.bits
-    io.ifOut.bits.predict := io.btbResult.valid && !io.pcOverwrite.valid
-    io.ifOut.bits.predictedTarget := io.btbResult.bits
+    io.ifOut.bits.pc := Cat(
+      f2.pc(31, FETCH_PACKET_WIDTH + 2),
+      0.U((FETCH_PACKET_WIDTH + 2).W)
+    )
+    io.ifOut.bits.insts := io.icache.resp.bits.insts
+    io.ifOut.bits.mask := f2.mask
+    io.ifOut.bits.predict := f2.predict
+    io.ifOut.bits.predictedTarget := f2.predictedTarget
+    io.ifOut.bits.ghist := f2.ghist
+    io.ifOut.bits.counters := f2.counters
 
-    io.icache.resp.ready := s2Fire
+    io.icache.resp.ready := f2Fire
 
     // Debugging Data
     when(io.ifOut.fire) {
         printf(
-          p"FETCH: PC=0x${Hexadecimal(io.ifOut.bits.pc)} Inst=0x${Hexadecimal(io.ifOut.bits.inst)} Predict=${io.ifOut.bits.predict}\n"
+          p"FETCH: PC=0x${Hexadecimal(io.ifOut.bits.pc)} Mask=${Binary(io.ifOut.bits.mask)} Predict=${io.ifOut.bits.predict}\n"
         )
     }
     when(io.pcOverwrite.valid) {
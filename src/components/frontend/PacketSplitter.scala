@@ -0,0 +1,41 @@
+package components.frontend
+
+import chisel3._
+import chisel3.util._
+import common._
+import common.Configurables.Derived._
+
+/** Packet Splitter
+  *
+  * Hands the valid slots of the fetch packet at the head of the fetch queue to
+  * the decoder one instruction per cycle. The packet is dequeued with its last
+  * instruction. A packet's prediction belongs to its last valid slot.
+  */
+class PacketSplitter extends Module {
+    val io = IO(new Bundle {
+        val in = Flipped(Decoupled(new FetchPacket))
+        val out = Decoupled(new FetchToDecodeBundle)
+    })
+
+    // Slots of the head packet already sent
+    val sent = RegInit(0.U(FETCH_PACKET_SIZE.W))
+
+    val remaining = io.in.bits.mask & ~sent
+    val slot = PriorityEncoder(remaining)
+    val slotOH = UIntToOH(slot, FETCH_PACKET_SIZE)
+    val last = (remaining & ~slotOH) === 0.U
+
+    io.out.valid := io.in.valid && remaining.orR
+    io.out.bits.pc := io.in.bits.pc + (slot << 2)
+    io.out.bits.inst := io.in.bits.insts(slot)
+    io.out.bits.predict := io.in.bits.predict && last
+    io.out.bits.predictedTarget := io.in.bits.predictedTarget
+    io.out.bits.bpMeta.ghist := io.in.bits.ghist
+    io.out.bits.bpMeta.counter := io.in.bits.counters(slot)
+
+    io.in.ready := io.out.ready && last
+
+    when(io.out.fire) {
+        sent := Mux(last, 0.U, sent | slotOH)
+    }
+}
@@ -23,6 +23,11 @@ class RASAdaptor extends CycleAwareModule {
 
         // Outputs
         val out = Decoupled(new RASAdaptorBundle)
+        // JAL the BTB missed, to be installed with its decoded target
+        val btbFill = Output(Valid(new Bundle {
+            val pc = UInt(32.W)
+            val target = UInt(32.W)
+        }))
     })
 
     val ras = Module(new ReturnAddressStack)
@@ -68,6 +73,10 @@ class RASAdaptor extends CycleAwareModule {
     // Spec: RET if J instruction (JALR) and rs1 is x1 or x5 and rd is x0
     val isRet = isJALR && (rd === 0.U) && (rs1 === 1.U || rs1 === 5.U)
 
+    io.btbFill.valid := false.B
+    io.btbFill.bits.pc := inPacket.pc
+    io.btbFill.bits.target := inPacket.pc + jImm
+
     when(io.recover) {
         printf(p"RAS: Recovering RAS to SP=${io.recoverSP}\n")
     }
@@ -94,6 +103,8 @@ class RASAdaptor extends CycleAwareModule {
         io.out.bits.currentSP := ras.io.currentSP
         io.out.bits.flush := fire && canCorrect && isPredictionWrong
         io.out.bits.flushNextPC := calculatedTarget
+        io.out.bits.ghist := inPacket.bpMeta.ghist
+        io.btbFill.valid := fire && isJAL && isPredictionWrong
 
         // Debugging Info
         when(canCorrect && isPredictionWrong && io.out.ready) {
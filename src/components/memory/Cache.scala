@@ -5,29 +5,97 @@ import chisel3.util._
 import common._
 import common.Configurables._
 
+/** Cache geometry
+  *
+  * Capacity is `nWays << (nSetsWidth + nCacheLineWidth)` bytes.
+  *
+  * @param nSetsWidth
+  *   log2 of the number of sets
+  * @param nCacheLineWidth
+  *   log2 of the line size in bytes
+  * @param idOffset
+  *   First request ID used by the cache on its memory port
+  * @param nWays
+  *   Associativity, a power of two (1 = direct-mapped)
+  * @param replacement
+  *   Replacement policy, unused when direct-mapped
+  * @param nMSHRs
+  *   Number of line misses that can be outstanding at once
+  * @param nMSHRTargets
+  *   Number of requests that can wait on one outstanding line
+  * @param nWriteBack
+  *   Number of evicted dirty lines waiting to be written to DRAM
+  */
 case class CacheConfig(
     nSetsWidth: Int,
     nCacheLineWidth: Int,
-    idOffset: Int = 0
+    idOffset: Int = 0,
+    nWays: Int = 1,
+    replacement: ReplacementPolicy = ReplacementPolicy.LRU,
+    nMSHRs: Int = 4,
+    nMSHRTargets: Int = 4,
+    nWriteBack: Int = 2
 )
 
+/** Cache request/response port
+  *
+  * Responses may come back in a different order than the requests were
+  * accepted; `respId` returns the `id` of the request being answered.
+  */
 class CachePort extends Bundle {
     val addr = Input(UInt(32.W))
     val wdata = Input(UInt(32.W))
     val wmask = Input(UInt(4.W))
     val isWr = Input(Bool())
+    val id = Input(UInt(MEM_TAG_WIDTH.W))
     val valid = Input(Bool())
     val rdata = Output(UInt(32.W))
+    val respId = Output(UInt(MEM_TAG_WIDTH.W))
     val respValid = Output(Bool())
     val ready = Output(Bool())
 }
 
-class CacheEvents extends Bundle {
+/** Write back every dirty line. `done` holds while `req` stays high after the
+  * walk has finished; the lines stay valid and become clean.
+  */
+class CacheFlush extends Bundle {
+    val req = Input(Bool())
+    val done = Output(Bool())
+}
+
+class CacheEvents(nWays: Int = 1) extends Bundle {
     val hit = Output(Bool())
     val miss = Output(Bool())
+    // Way that hit, or the way chosen for the refill on a miss
+    val way = Output(UInt((log2Ceil(nWays) max 1).W))
+    // A prefetch got an MSHR / a demand access used a prefetched line
+    val prefetchIssued = Output(Bool())
+    val prefetchUseful = Output(Bool())
+    // The line was in a different way than predicted (I-cache only)
+    val wayMispredict = Output(Bool())
 }
 
-/** A simple direct-mapped write-back cache
+/** A set-associative, non-blocking write-back cache
+  *
+  * Direct-mapped when `conf.nWays` is 1. On a miss an invalid way is filled
+  * first, otherwise the replacement policy picks the victim.
+  *
+  * Lookups are pipelined: a request is accepted in the cycle the previous one
+  * is tag-checked, so hits complete one per cycle.
+  *
+  * Misses are tracked in miss status holding registers (MSHRs), so hits are
+  * served while refills are outstanding. A load that misses on a line which
+  * is already being fetched is added to that MSHR's targets. Stores to such a
+  * line wait until it is filled, so every MSHR holds at most one store, its
+  * first target.
+  *
+  * Dirty victims move to a writeback buffer, so the refill read goes to DRAM
+  * first and the writeback drains when no read is waiting. A miss on a line
+  * that is still in the buffer takes its data from there.
+  *
+  * Prefetch requests on `io.prefetch` are looked up when no demand request
+  * is waiting. A missing line gets an MSHR with no targets; requests that
+  * hit, are already in flight or cannot be placed are dropped.
   *
   * @param conf
   *   Cache configuration parameters
@@ -42,26 +110,84 @@ class Cache(conf: CacheConfig) extends Module {
             dataWidth = (1 << conf.nCacheLineWidth) * 8
           )
         )
-        val events = new CacheEvents
+        val events = new CacheEvents(conf.nWays)
+        val flush = new CacheFlush
+        val prefetch = Flipped(Decoupled(UInt(32.W)))
     })
 
+    val nWays = conf.nWays
+    val wayBits = log2Ceil(nWays) max 1
     val nSets = 1 << conf.nSetsWidth
     val nBytes = 1 << conf.nCacheLineWidth
     val tagWidth = 32 - conf.nSetsWidth - conf.nCacheLineWidth
+    val lineWidth = 32 - conf.nCacheLineWidth
 
+    // One write ID, then one read ID per MSHR
+    require(conf.nMSHRs >= 1 && conf.nMSHRTargets >= 1)
+    require(conf.idOffset + 1 + conf.nMSHRs <= 16, "Out of DRAM request IDs")
+    val nDramIds = conf.idOffset + 1 + conf.nMSHRs // IDs used on the port
     val WR_ID = (0 + conf.idOffset).U(4.W)
-    val RD_ID = (1 + conf.idOffset).U(4.W)
+    def RD_ID(i: Int) = (1 + i + conf.idOffset).U(4.W)
 
     class CacheEntry extends Bundle {
         val valid = Bool()
         val tag = UInt(tagWidth.W)
         val dirty = Bool()
+        // Brought in by a prefetch and not used yet
+        val prefetched = Bool()
     }
 
-    val mem = SyncReadMem(nSets, Vec(nBytes, UInt(8.W)))
-    val tags = SyncReadMem(nSets, new CacheEntry)
+    class MSHRTarget extends Bundle {
+        val id = UInt(MEM_TAG_WIDTH.W)
+        val offset = UInt(conf.nCacheLineWidth.W)
+        val isWr = Bool()
+        val wdata = UInt(32.W)
+        val wmask = UInt(4.W)
+    }
 
-    val sIdle :: sTagCheck :: sDramAccess :: sReplayRead :: Nil = Enum(4)
+    class MSHR extends Bundle {
+        val valid = Bool()
+        val line = UInt(lineWidth.W) // tag and index of the missing line
+        val way = UInt(wayBits.W)
+        val readSent = Bool()
+        // Allocated by a prefetch that no demand request has merged with
+        val prefetch = Bool()
+        val refilled = Bool()
+        val data = Vec(nBytes, UInt(8.W))
+        val nTargets = UInt(log2Ceil(conf.nMSHRTargets + 1).W)
+        val targets = Vec(conf.nMSHRTargets, new MSHRTarget)
+    }
+
+    class WriteBackEntry extends Bundle {
+        val valid = Bool()
+        val line = UInt(lineWidth.W)
+        val data = Vec(nBytes, UInt(8.W))
+    }
+
+    // The lines of all ways of a set are stored side by side, so that single
+    // bytes of one way can be written through the mask
+    val mem = SyncReadMem(nSets, Vec(nWays * nBytes, UInt(8.W)))
+    val tags = SyncReadMem(nSets, Vec(nWays, new CacheEntry))
+    val replacement = Module(
+      new CacheReplacement(nSets, nWays, conf.replacement)
+    )
+
+    val mshrs = RegInit(
+      VecInit(Seq.fill(conf.nMSHRs)(0.U.asTypeOf(new MSHR)))
+    )
+
+    // Writeback buffer, drained in FIFO order. It holds at most one entry per
+    // line: a line evicted again while still buffered overwrites its entry.
+    val wbBuf = RegInit(
+      VecInit(Seq.fill(conf.nWriteBack)(0.U.asTypeOf(new WriteBackEntry)))
+    )
+    val wbHead = RegInit(0.U(log2Ceil(conf.nWriteBack).max(1).W))
+    val wbTail = RegInit(0.U(log2Ceil(conf.nWriteBack).max(1).W))
+    private def wbNext(p: UInt): UInt =
+        Mux(p === (conf.nWriteBack - 1).U, 0.U, p + 1.U)
+
+    val sIdle :: sTagCheck :: sReplayRead :: sFill :: sRespond :: sFlushRead :: sFlushCheck :: sFlushWrite :: Nil =
+        Enum(8)
     val state = RegInit(sIdle)
 
     val reqReg = Reg(new Bundle {
@@ -69,16 +195,29 @@ class Cache(conf: CacheConfig) extends Module {
         val wdata = UInt(32.W)
         val wmask = UInt(4.W)
         val isWr = Bool()
+        val id = UInt(MEM_TAG_WIDTH.W)
+        val isPrefetch = Bool()
     })
+    // A request is held in reqReg until it hits, or is handed to an MSHR
+    val reqPending = RegInit(false.B)
 
     val sentWrite = RegInit(false.B)
-    val sentRead = RegInit(false.B)
     val gotWriteResp = RegInit(false.B)
-    val gotReadResp = RegInit(false.B)
-    val isRefill = RegInit(false.B)
+    // Writebacks sent but not acknowledged yet; all share WR_ID. Sent
+    // writebacks leave the buffer, so the count is bounded by DRAM (16 in
+    // flight) rather than by `nWriteBack`. No more are sent once it saturates.
+    val wbLimit = 16
+    val wbInFlight = RegInit(0.U(log2Ceil(wbLimit + 1).W))
+    val wbCanSend = wbInFlight =/= wbLimit.U
+    val wbSent = io.dram.req.fire && io.dram.req.bits.id === WR_ID
+    val wbAcked = io.dram.resp.valid && io.dram.resp.bits.id === WR_ID
+    wbInFlight := wbInFlight + wbSent.asUInt - wbAcked.asUInt
 
     io.events.hit := false.B
     io.events.miss := false.B
+    io.events.prefetchIssued := false.B
+    io.events.prefetchUseful := false.B
+    io.events.wayMispredict := false.B
 
     // Signals for Logic
     val reg_index = reqReg.addr(
@@ -87,146 +226,500 @@ class Cache(conf: CacheConfig) extends Module {
     )
     val reg_tag = reqReg.addr(31, conf.nCacheLineWidth + conf.nSetsWidth)
     val reg_offset = reqReg.addr(conf.nCacheLineWidth - 1, 0)
-    val port_index = io.port.addr(
+    val reg_line = reqReg.addr(31, conf.nCacheLineWidth)
+    // Demand requests take precedence over prefetches
+    val accept_addr = Mux(io.port.valid, io.port.addr, io.prefetch.bits)
+    val port_index = accept_addr(
       conf.nCacheLineWidth + conf.nSetsWidth - 1,
       conf.nCacheLineWidth
     )
 
+    // Refilled MSHR being written into the arrays and answered
+    val fillIdx = Reg(UInt(log2Ceil(conf.nMSHRs).max(1).W))
+    val fillMSHR = mshrs(fillIdx)
+    val fill_index = fillMSHR.line(conf.nSetsWidth - 1, 0)
+    val respIdx = Reg(UInt(log2Ceil(conf.nMSHRTargets).max(1).W))
+
+    // Flush walk state
+    val flushIndex = RegInit(0.U(conf.nSetsWidth.W))
+    val flushTag = Reg(UInt(tagWidth.W))
+    val flushWay = Reg(UInt(wayBits.W))
+    val flushed = RegInit(false.B)
+    val isFlushing =
+        state === sFlushRead || state === sFlushCheck || state === sFlushWrite
+
     val isReplay = (state === sReplayRead)
-    val read_index = Mux(isReplay, reg_index, port_index)
-    val read_enable = (state === sIdle && io.port.valid) || isReplay
+    val read_index = Mux(
+      isReplay,
+      reg_index,
+      Mux(state === sFlushRead, flushIndex, port_index)
+    )
+    val write_index = Mux(
+      isFlushing,
+      flushIndex,
+      Mux(state === sFill, fill_index, reg_index)
+    )
 
     // Single Read Calls
+    val read_enable = WireInit(false.B)
     val tagRead = tags.read(read_index, read_enable)
     val dataRead = mem.read(read_index, read_enable)
+    val dataWays = VecInit(
+      Seq.tabulate(nWays)(w =>
+          VecInit(dataRead.slice(w * nBytes, (w + 1) * nBytes))
+      )
+    )
+
+    private def wayIndex(oneHot: Seq[Bool]): UInt =
+        if (nWays == 1) 0.U(wayBits.W) else OHToUInt(oneHot)
+    private def firstWay(v: Seq[Bool]): UInt =
+        if (nWays == 1) 0.U(wayBits.W) else PriorityEncoder(v)
+
+    // Aligned word of a line at a byte offset
+    private def wordAt(line: Vec[UInt], offset: UInt): UInt = {
+        val aligned = Cat(offset(conf.nCacheLineWidth - 1, 2), 0.U(2.W))
+        Cat(
+          line((aligned + 3.U).asUInt),
+          line((aligned + 2.U).asUInt),
+          line((aligned + 1.U).asUInt),
+          line(aligned.asUInt)
+        )
+    }
+    // Byte write enables and data of a word store into a line
+    private def storeMask(offset: UInt, wmask: UInt): Vec[Bool] = {
+        val full = wmask << offset
+        VecInit(Seq.tabulate(nBytes)(i => full(i)))
+    }
+    private def storeData(wdata: UInt): Vec[UInt] = {
+        val bytes = Seq.tabulate(4)(i => wdata(8 * i + 7, 8 * i))
+        VecInit(Seq.fill(nBytes / 4)(bytes).flatten)
+    }
+    // Refilled line with the store of the first target applied
+    private def refillData(line: Vec[UInt], first: MSHRTarget): Vec[UInt] = {
+        val mask = storeMask(first.offset, first.wmask)
+        val wdata = storeData(first.wdata)
+        VecInit(
+          Seq.tabulate(nBytes)(b =>
+              Mux(first.isWr && mask(b), wdata(b), line(b))
+          )
+        )
+    }
 
     // Write Wires
     val mem_wen = WireInit(false.B)
+    val mem_way = WireInit(0.U(wayBits.W))
     val mem_wmask = Wire(Vec(nBytes, Bool()))
     val mem_wdata = Wire(Vec(nBytes, UInt(8.W)))
     mem_wmask := VecInit(Seq.fill(nBytes)(false.B))
     mem_wdata := VecInit(Seq.fill(nBytes)(0.U(8.W)))
 
     val tags_wen = WireInit(false.B)
+    val tags_way = WireInit(0.U(wayBits.W))
     val tags_wdata = Wire(new CacheEntry)
     tags_wdata := DontCare
 
+    // MSHR status
+    val mshrBusy = mshrs.map(_.valid).reduce(_ || _)
+    val refilledVec = mshrs.map(m => m.valid && m.refilled)
+    val anyRefilled = refilledVec.reduce(_ || _)
+
     // Logic
-    io.port.ready := (state === sIdle)
+    read_enable := (io.port.valid && io.port.ready) || io.prefetch.fire ||
+        isReplay || state === sFlushRead
+
+    io.port.respValid := false.B
+    io.port.rdata := 0.U
+    io.port.respId := reqReg.id
+    io.dram.req.valid := false.B
+    io.dram.req.bits := DontCare
+    io.dram.resp.ready := true.B
+
+    private def sendWriteBack(addr: UInt, data: Vec[UInt]): Bool = {
+        io.dram.req.valid := wbCanSend
+        io.dram.req.bits.id := WR_ID
+        io.dram.req.bits.addr := addr
+        io.dram.req.bits.data := data.asUInt
+        io.dram.req.bits.isWr := true.B
+        io.dram.req.bits.mask := Fill(nBytes, 1.U(1.W))
+        io.dram.req.ready && wbCanSend
+    }
+
+    private def startFill(): Unit = {
+        fillIdx := PriorityEncoder(refilledVec)
+        state := sFill
+    }
+
+    // Hit detection and victim selection for the request in sTagCheck
+    val hitVec = tagRead.map(e => e.valid && e.tag === reg_tag)
+    val hit = hitVec.reduce(_ || _)
+    val hitWay = wayIndex(hitVec)
+
+    // Ways of the set that an outstanding MSHR is going to fill
+    val reservedVec = Seq.tabulate(nWays)(w =>
+        mshrs
+            .map(m =>
+                m.valid && m.line(conf.nSetsWidth - 1, 0) === reg_index &&
+                    m.way === w.U
+            )
+            .reduce(_ || _)
+    )
+    val invalidVec =
+        tagRead.zip(reservedVec).map { case (e, r) => !e.valid && !r }
+    val freeWayVec = reservedVec.map(!_)
+    val policyVictim = replacement.io.victim
+    replacement.io.set := reg_index
+    val victimWay = Mux(
+      invalidVec.reduce(_ || _),
+      firstWay(invalidVec),
+      Mux(
+        VecInit(freeWayVec)(policyVictim),
+        policyVictim,
+        firstWay(freeWayVec)
+      )
+    )
+    val victimAvailable = freeWayVec.reduce(_ || _)
+
+    // Outstanding MSHRs related to the request
+    val matchVec = mshrs.map(m => m.valid && m.line === reg_line)
+    val mshrMatch = matchVec.reduce(_ || _)
+    val matchIdx = PriorityEncoder(matchVec)
+    val matchMSHR = mshrs(matchIdx)
+    val freeVec = mshrs.map(!_.valid)
+    val freeIdx = PriorityEncoder(freeVec)
+
+    // A missing line still in the writeback buffer is taken from there; a
+    // DRAM read could overtake the buffered write
+    val wbHitVec = wbBuf.map(e => e.valid && e.line === reg_line)
+    val wbHit = wbHitVec.reduce(_ || _)
+    val wbHitData = Mux1H(wbHitVec, wbBuf.map(_.data))
+
+    // A dirty victim needs its buffered entry, or a free slot. The head entry
+    // may leave this cycle, so it is not overwritten.
+    val victim = tagRead(victimWay)
+    val victimLine = Cat(victim.tag, reg_index)
+    val victimDirty = victim.valid && victim.dirty
+    val wbHeadFire = Wire(Bool())
+    val wbCoalesceVec = wbBuf.zipWithIndex.map { case (e, i) =>
+        e.valid && e.line === victimLine && !(wbHeadFire && wbHead === i.U)
+    }
+    val wbCoalesce = wbCoalesceVec.reduce(_ || _)
+    val wbSpace = !wbBuf(wbTail).valid
+
+    val canMerge = mshrMatch && !reqReg.isWr &&
+        matchMSHR.nTargets =/= conf.nMSHRTargets.U
+    val canAllocate = !mshrMatch && freeVec.reduce(_ || _) &&
+        victimAvailable && (!victimDirty || wbCoalesce || wbSpace)
+
+    replacement.io.touch.valid := false.B
+    replacement.io.touch.bits.set := reg_index
+    replacement.io.touch.bits.way := hitWay
+    io.events.way := Mux(
+      hit,
+      hitWay,
+      Mux(mshrMatch, matchMSHR.way, victimWay)
+    )
+
+    val newTarget = Wire(new MSHRTarget)
+    newTarget.id := reqReg.id
+    newTarget.offset := reg_offset
+    newTarget.isWr := reqReg.isWr
+    newTarget.wdata := reqReg.wdata
+    newTarget.wmask := reqReg.wmask
+
+    val demand = !reqReg.isPrefetch
+    val hitPrefetched = tagRead(hitWay).prefetched
+
+    when(state === sTagCheck) {
+        io.events.hit := demand && hit
+        io.events.miss := demand && !hit &&
+            (canAllocate || (canMerge && !matchMSHR.prefetch))
+        io.events.prefetchUseful := demand && Mux(
+          hit,
+          hitPrefetched,
+          canMerge && matchMSHR.prefetch
+        )
+        io.events.prefetchIssued := !demand && !hit && canAllocate
+
+        when(hit) {
+            when(demand) {
+                replacement.io.touch.valid := true.B
+                io.port.respValid := true.B
+                io.port.respId := reqReg.id
+                tags_wdata := tagRead(hitWay)
+                tags_wdata.prefetched := false.B
+                tags_way := hitWay
+                when(reqReg.isWr) {
+                    mem_wdata := storeData(reqReg.wdata)
+                    mem_wmask := storeMask(reg_offset, reqReg.wmask)
+                    mem_way := hitWay
+                    mem_wen := true.B
+
+                    tags_wdata.dirty := true.B
+                    tags_wen := true.B
+                }.otherwise {
+                    io.port.rdata := wordAt(dataWays(hitWay), reg_offset)
+                    tags_wen := hitPrefetched
+                }
+            }
+            reqPending := false.B
+            state := sIdle
+        }.elsewhen(canMerge || (!demand && mshrMatch)) {
+            when(demand) {
+                matchMSHR.targets(matchMSHR.nTargets) := newTarget
+                matchMSHR.nTargets := matchMSHR.nTargets + 1.U
+                matchMSHR.prefetch := false.B
+            }
+            reqPending := false.B
+            state := sIdle
+        }.elsewhen(canAllocate) {
+            val m = mshrs(freeIdx)
+            m.valid := true.B
+            m.line := reg_line
+            m.way := victimWay
+            m.readSent := wbHit
+            m.refilled := wbHit
+            m.prefetch := !demand
+            m.data := refillData(wbHitData, newTarget)
+            m.nTargets := Mux(demand, 1.U, 0.U)
+            m.targets(0) := newTarget
+
+            when(victimDirty) {
+                when(wbCoalesce) {
+                    for ((e, c) <- wbBuf.zip(wbCoalesceVec)) {
+                        when(c) { e.data := dataWays(victimWay) }
+                    }
+                }.otherwise {
+                    wbBuf(wbTail).valid := true.B
+                    wbBuf(wbTail).line := victimLine
+                    wbBuf(wbTail).data := dataWays(victimWay)
+                    wbTail := wbNext(wbTail)
+                }
+            }
+
+            // The victim leaves the cache now; its way stays reserved
+            tags_wdata.valid := false.B
+            tags_wdata.dirty := false.B
+            tags_wdata.prefetched := false.B
+            tags_way := victimWay
+            tags_wen := true.B
+            reqPending := false.B
+            state := sIdle
+        }.otherwise {
+            // No MSHR can take the request yet: retry after the next fill.
+            // A prefetch is dropped instead.
+            when(anyRefilled) { startFill() }
+                .elsewhen(demand) { state := sReplayRead }
+                .otherwise { state := sIdle }
+        }
+    }
+
+    when(state === sReplayRead) { state := sTagCheck }
+
+    // Accept a new request while the previous one finishes its tag check, so
+    // hits are served one per cycle. A tag check that writes the arrays holds
+    // back a request to the same set, whose read would return the old
+    // contents. A refilled line is written back into the arrays before new
+    // requests are accepted, which bounds how long its targets wait.
+    val tagCheckDone = state === sTagCheck &&
+        (hit || canMerge || canAllocate || !demand)
+    val tagCheckWrites = reqReg.isWr || !hit || hitPrefetched
+    val setHazard = tagCheckWrites && port_index === reg_index
+    io.port.ready := !io.flush.req && !anyRefilled &&
+        (state === sIdle || (tagCheckDone && !setHazard))
 
     when(io.port.valid && io.port.ready) {
         reqReg.addr := io.port.addr
         reqReg.wdata := io.port.wdata
         reqReg.wmask := io.port.wmask
         reqReg.isWr := io.port.isWr
-        isRefill := false.B
+        reqReg.id := io.port.id
+        reqReg.isPrefetch := false.B
+        reqPending := true.B
         state := sTagCheck
     }
 
-    val dramWriteBackData = Reg(Vec(nBytes, UInt(8.W)))
-    val dramWriteBackAddr = Reg(UInt(32.W))
-    val dramReadAddr = Reg(UInt(32.W))
+    // Prefetches only use cycles with no demand request
+    io.prefetch.ready := state === sIdle && !io.port.valid &&
+        !io.flush.req && !anyRefilled
+    when(io.prefetch.fire) {
+        reqReg.addr := io.prefetch.bits
+        reqReg.isWr := false.B
+        reqReg.isPrefetch := true.B
+        state := sTagCheck
+    }
 
-    io.port.respValid := false.B
-    io.port.rdata := 0.U
-    io.dram.req.valid := false.B
-    io.dram.req.bits := DontCare
-    io.dram.resp.ready := true.B
+    when(state === sIdle && anyRefilled) { startFill() }
 
-    when(state === sTagCheck) {
-        val hit = tagRead.valid && (tagRead.tag === reg_tag)
-        io.events.hit := hit && !isRefill
-        io.events.miss := !hit
+    // DRAM requests: refill reads first, buffered writebacks when no read
+    // is waiting
+    val sendVec = mshrs.map(m => m.valid && !m.readSent)
+    val sendIdx = PriorityEncoder(sendVec)
+    val sendMSHR = mshrs(sendIdx)
+    val wbHeadEntry = wbBuf(wbHead)
+    wbHeadFire := false.B
+    when(sendVec.reduce(_ || _) && !isFlushing) {
+        io.dram.req.valid := true.B
+        io.dram.req.bits.id := VecInit(
+          Seq.tabulate(conf.nMSHRs)(RD_ID)
+        )(sendIdx)
+        io.dram.req.bits.addr := Cat(
+          sendMSHR.line,
+          0.U(conf.nCacheLineWidth.W)
+        )
+        io.dram.req.bits.isWr := false.B
+        io.dram.req.bits.mask := 0.U
+        when(io.dram.req.ready) { sendMSHR.readSent := true.B }
+    }.elsewhen(wbHeadEntry.valid && !isFlushing) {
+        wbHeadFire := sendWriteBack(
+          Cat(wbHeadEntry.line, 0.U(conf.nCacheLineWidth.W)),
+          wbHeadEntry.data
+        )
+        when(wbHeadFire) {
+            wbHeadEntry.valid := false.B
+            wbHead := wbNext(wbHead)
+        }
+    }
+    val wbEmpty = !wbBuf.map(_.valid).reduce(_ || _)
 
-        when(hit) {
-            when(reqReg.isWr) {
-                val wdataBytesSeq =
-                    Seq.tabulate(4)(i => reqReg.wdata(8 * i + 7, 8 * i))
-                mem_wdata := VecInit(
-                  Seq.fill(nBytes / 4)(wdataBytesSeq).flatten
+    // Refill data. Writeback acknowledgements need no action: DRAM applies a
+    // write when it accepts it, ahead of any later read of the same line.
+    for (i <- 0 until conf.nMSHRs) {
+        val m = mshrs(i)
+        when(io.dram.resp.valid && io.dram.resp.bits.id === RD_ID(i)) {
+            m.data := refillData(
+              VecInit(
+                Seq.tabulate(nBytes)(b =>
+                    io.dram.resp.bits.data(8 * b + 7, 8 * b)
                 )
-                val fullMaskUInt = reqReg.wmask << reg_offset
-                mem_wmask := VecInit(Seq.tabulate(nBytes)(i => fullMaskUInt(i)))
-                mem_wen := true.B
+              ),
+              m.targets(0)
+            )
+            m.refilled := true.B
+        }
+    }
 
-                tags_wdata := tagRead
-                tags_wdata.dirty := true.B
-                tags_wen := true.B
+    // Fill: install the refilled line, then answer its targets one per cycle
+    when(state === sFill) {
+        mem_wdata := fillMSHR.data
+        mem_wmask := VecInit(Seq.fill(nBytes)(true.B))
+        mem_way := fillMSHR.way
+        mem_wen := true.B
 
-                io.port.respValid := true.B
-                state := sIdle
-            }.otherwise {
-                val aligned_offset =
-                    Cat(reg_offset(conf.nCacheLineWidth - 1, 2), 0.U(2.W))
-                io.port.rdata := Cat(
-                  dataRead((aligned_offset + 3.U).asUInt),
-                  dataRead((aligned_offset + 2.U).asUInt),
-                  dataRead((aligned_offset + 1.U).asUInt),
-                  dataRead(aligned_offset.asUInt)
-                )
-                io.port.respValid := true.B
-                state := sIdle
-            }
+        tags_wdata.valid := true.B
+        tags_wdata.tag := fillMSHR.line(lineWidth - 1, conf.nSetsWidth)
+        tags_wdata.dirty := fillMSHR.targets(0).isWr
+        tags_wdata.prefetched := fillMSHR.prefetch
+        tags_way := fillMSHR.way
+        tags_wen := true.B
+
+        replacement.io.touch.valid := true.B
+        replacement.io.touch.bits.set := fill_index
+        replacement.io.touch.bits.way := fillMSHR.way
+
+        // A prefetch nobody has asked for yet has no targets to answer
+        respIdx := 0.U
+        when(fillMSHR.nTargets === 0.U) {
+            fillMSHR.valid := false.B
+            state := Mux(reqPending, sReplayRead, sIdle)
         }.otherwise {
-            val dirty = tagRead.dirty && tagRead.valid
-            dramWriteBackAddr := Cat(
-              tagRead.tag,
-              reg_index,
+            state := sRespond
+        }
+    }
+
+    when(state === sRespond) {
+        val target = fillMSHR.targets(respIdx)
+        io.port.respValid := true.B
+        io.port.respId := target.id
+        io.port.rdata := Mux(
+          target.isWr,
+          0.U,
+          wordAt(fillMSHR.data, target.offset)
+        )
+        respIdx := respIdx + 1.U
+        when(respIdx === fillMSHR.nTargets - 1.U) {
+            fillMSHR.valid := false.B
+            state := Mux(reqPending, sReplayRead, sIdle)
+        }
+    }
+
+    // Flush: walk every set, writing dirty lines back one at a time. A set is
+    // read again after each writeback until none of its ways is dirty.
+    when(
+      state === sIdle && io.flush.req && !flushed && !mshrBusy &&
+          wbEmpty && wbInFlight === 0.U
+    ) {
+        flushIndex := 0.U
+        state := sFlushRead
+    }
+
+    private def nextFlushSet(): Unit = {
+        val lastSet = flushIndex === (nSets - 1).U
+        flushIndex := flushIndex + 1.U
+        state := Mux(lastSet, sIdle, sFlushRead)
+        when(lastSet) { flushed := true.B }
+    }
+
+    when(state === sFlushRead) { state := sFlushCheck }
+
+    val flushWriteBackAddr = Reg(UInt(32.W))
+    val flushWriteBackData = Reg(Vec(nBytes, UInt(8.W)))
+
+    when(state === sFlushCheck) {
+        val dirtyVec = tagRead.map(e => e.valid && e.dirty)
+        val way = firstWay(dirtyVec)
+        when(dirtyVec.reduce(_ || _)) {
+            flushWriteBackAddr := Cat(
+              tagRead(way).tag,
+              flushIndex,
               0.U(conf.nCacheLineWidth.W)
             )
-            dramReadAddr := Cat(reg_tag, reg_index, 0.U(conf.nCacheLineWidth.W))
-            when(dirty) { dramWriteBackData := dataRead }
-            sentWrite := !dirty
-            gotWriteResp := !dirty
-            sentRead := false.B
-            gotReadResp := false.B
-            isRefill := true.B
-            state := sDramAccess
+            flushWriteBackData := dataWays(way)
+            flushTag := tagRead(way).tag
+            flushWay := way
+            sentWrite := false.B
+            gotWriteResp := false.B
+            state := sFlushWrite
+        }.otherwise {
+            nextFlushSet()
         }
     }
 
-    when(state === sDramAccess) {
+    when(state === sFlushWrite) {
         when(!sentWrite) {
-            io.dram.req.valid := true.B
-            io.dram.req.bits.id := WR_ID
-            io.dram.req.bits.addr := dramWriteBackAddr
-            io.dram.req.bits.data := dramWriteBackData.asUInt
-            io.dram.req.bits.isWr := true.B
-            io.dram.req.bits.mask := Fill(nBytes, 1.U(1.W))
-            when(io.dram.req.ready) { sentWrite := true.B }
-        }.elsewhen(!sentRead) {
-            io.dram.req.valid := true.B
-            io.dram.req.bits.id := RD_ID
-            io.dram.req.bits.addr := dramReadAddr
-            io.dram.req.bits.isWr := false.B
-            io.dram.req.bits.mask := 0.U
-            when(io.dram.req.ready) { sentRead := true.B }
-        }
-
-        when(io.dram.resp.valid) {
-            when(io.dram.resp.bits.id === WR_ID) { gotWriteResp := true.B }
-            when(io.dram.resp.bits.id === RD_ID) {
-                mem_wdata := VecInit(
-                  Seq.tabulate(nBytes)(i =>
-                      io.dram.resp.bits.data(8 * i + 7, 8 * i)
-                  )
-                )
-                mem_wmask := VecInit(Seq.fill(nBytes)(true.B))
-                mem_wen := true.B
-
-                tags_wdata.valid := true.B
-                tags_wdata.tag := reg_tag
-                tags_wdata.dirty := false.B
-                tags_wen := true.B
-                gotReadResp := true.B
+            when(sendWriteBack(flushWriteBackAddr, flushWriteBackData)) {
+                sentWrite := true.B
             }
         }
-        when(gotWriteResp && gotReadResp) { state := sReplayRead }
+        when(wbAcked) { gotWriteResp := true.B }
+        when(gotWriteResp) {
+            tags_wdata.valid := true.B
+            tags_wdata.tag := flushTag
+            tags_wdata.dirty := false.B
+            tags_wdata.prefetched := false.B
+            tags_way := flushWay
+            tags_wen := true.B
+            state := sFlushRead
+        }
     }
 
-    when(state === sReplayRead) { state := sTagCheck }
+    when(!io.flush.req) { flushed := false.B }
+    io.flush.done := flushed && state === sIdle
 
-    // Single Write Calls
-    when(mem_wen) { mem.write(reg_index, mem_wdata, mem_wmask) }
-    when(tags_wen) { tags.write(reg_index, tags_wdata) }
+    // Single Write Calls, masked to one way
+    when(mem_wen) {
+        mem.write(
+          write_index,
+          VecInit(Seq.fill(nWays)(mem_wdata).flatten),
+          Seq.tabulate(nWays * nBytes)(i =>
+              mem_wmask(i % nBytes) && mem_way === (i / nBytes).U
+          )
+        )
+    }
+    when(tags_wen) {
+        tags.write(
+          write_index,
+          VecInit(Seq.fill(nWays)(tags_wdata)),
+          Seq.tabulate(nWays)(w => tags_way === w.U)
+        )
+    }
 }
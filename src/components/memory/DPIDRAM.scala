@@ -2,32 +2,97 @@ package components.memory
 
 import chisel3._
 import chisel3.util._
+import chisel3.experimental.{IntParam, StringParam}
+
+/** Architectural state exchanged with the DRAM model for checkpoints
+  *
+  * `regs` packs x0-x31, with x(i) in bits [32i+31:32i].
+  */
+class ArchState extends Bundle {
+    val pc = UInt(32.W)
+    val regs = UInt((32 * 32).W)
+}
 
 class DPIDRAMIO(conf: MemConfig) extends Bundle {
     val req = Flipped(Decoupled(new MemRequest(conf)))
     val resp = Decoupled(new MemResponse(conf))
+    // Pulse to write a checkpoint of memory and the given state
+    val ckpt = Flipped(Valid(new ArchState))
+    // State to start from: ELF entry point or restored checkpoint
+    val boot = Output(new ArchState)
     val clock = Input(Clock())
     val reset = Input(Bool())
 }
 
+/** DRAM timing parameters for the DPI model
+  *
+  * All latencies are in core clock cycles. Each value is only a default: the
+  * simulator can override it at runtime with the matching `+dram_*` plusarg
+  * (e.g. `+dram_trcd=14`).
+  *
+  * @param nBanks
+  *   Number of banks, rounded up to a power of two (`+dram_banks`)
+  * @param rowBytes
+  *   Row buffer size in bytes, rounded up to a power of two
+  *   (`+dram_row_bytes`)
+  * @param tCAS
+  *   Column access latency for an open row (`+dram_tcas`)
+  * @param tRCD
+  *   Row activate latency (`+dram_trcd`)
+  * @param tRP
+  *   Precharge latency when another row is open (`+dram_trp`)
+  * @param busBytes
+  *   Channel bandwidth in bytes per cycle (`+dram_bus_bytes`)
+  * @param openPage
+  *   Keep rows open after an access, otherwise auto-precharge
+  *   (`+dram_open_page`)
+  */
+case class DRAMTiming(
+    nBanks: Int = 8,
+    rowBytes: Int = 2048,
+    tCAS: Int = 10,
+    tRCD: Int = 10,
+    tRP: Int = 10,
+    busBytes: Int = 8,
+    openPage: Boolean = true
+)
+
 /** DPIDRAM BlackBox Wrapper
   *
-  * Provides a Uniform Memory Interface for the CPU.
+  * Provides a Uniform Memory Interface for the CPU. Requests are timed by a
+  * bank / row buffer model, see `docs/dram.md`. The model also writes and
+  * restores checkpoints (`+dram_ckpt_out` picks the output file).
   *
   * @param conf
   *   Memory configuration parameters
   * @param hexFile
   *   Hex file to initialize DRAM contents
+  * @param timing
+  *   Default timing parameters of the DRAM model
   *
   * @note
   *   DPI Stands for Direct Programming Interface
   */
-class DPIDRAM(conf: MemConfig, hexFile: String)
-    extends BlackBox(Map("FILENAME" -> hexFile))
+class DPIDRAM(
+    conf: MemConfig,
+    hexFile: String,
+    timing: DRAMTiming = DRAMTiming()
+) extends BlackBox(
+      Map(
+        "FILENAME" -> StringParam(hexFile),
+        "N_BANKS" -> IntParam(timing.nBanks),
+        "ROW_BYTES" -> IntParam(timing.rowBytes),
+        "T_CAS" -> IntParam(timing.tCAS),
+        "T_RCD" -> IntParam(timing.tRCD),
+        "T_RP" -> IntParam(timing.tRP),
+        "BUS_BYTES" -> IntParam(timing.busBytes),
+        "OPEN_PAGE" -> IntParam(if (timing.openPage) 1 else 0)
+      )
+    )
     with HasBlackBoxResource {
     val io = IO(new DPIDRAMIO(conf))
 
-    // Force rebuild 8
+    // Force rebuild 10
     addResource("/DPIDRAM.sv")
     addResource("/dram.cc")
 }
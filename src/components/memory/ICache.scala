@@ -7,18 +7,33 @@ import common.Configurables._
 
 /** Instruction Cache
   *
-  * A simple direct-mapped instruction cache.
+  * A set-associative instruction cache with a stream buffer. Each hit returns
+  * the aligned fetch packet of `FETCH_PACKET_SIZE` instructions that holds the
+  * requested address.
+  *
+  * Tags of all ways are read in parallel, but data is read only from the way
+  * predicted for the set (the way that last hit or was filled). A hit in any
+  * other way retrains the predictor and is reported as not ready; the fetcher
+  * retries the next cycle. New lines go to an invalid way first, otherwise to
+  * the victim of the replacement policy.
+  *
+  * A demand miss restarts the stream at the next line. The stream buffer then
+  * keeps `streamDepth` sequential lines in flight or buffered, each slot with
+  * its own request ID. A miss on a buffered line moves it into the cache instead
+  * of going to DRAM.
   *
   * @param conf
   *   Cache configuration parameters
+  * @param streamDepth
+  *   Number of lines prefetched ahead
   */
-class ICache(conf: CacheConfig) extends Module {
+class ICache(conf: CacheConfig, streamDepth: Int = 4) extends Module {
     val io = IO(new Bundle {
         // Request Interface
         val req = Flipped(Decoupled(UInt(32.W))) // .bits = addr, .valid = req
 
         // Response Interface
-        val resp = Decoupled(UInt(32.W)) // .bits = data, .valid = hit
+        val resp = Decoupled(new ICacheResp) // .bits = packet, .valid = hit
 
         // DRAM Interface
         val dram = new SimpleMemIO(
@@ -28,21 +43,33 @@ class ICache(conf: CacheConfig) extends Module {
             dataWidth = (1 << conf.nCacheLineWidth) * 8
           )
         )
-        val events = new CacheEvents
+        val events = new CacheEvents(conf.nWays)
     })
 
     val nSets = 1 << conf.nSetsWidth
     val nBytes = 1 << conf.nCacheLineWidth
+    val nWays = conf.nWays
+    val wayBits = log2Ceil(nWays) max 1
     val tagWidth = 32 - conf.nSetsWidth - conf.nCacheLineWidth
-    val RD_ID = (1 + conf.idOffset).U(4.W)
+    val RD_ID = conf.idOffset.U(4.W)
+    require(streamDepth >= 1)
+    require(
+      conf.nCacheLineWidth >= FETCH_PACKET_WIDTH + 2,
+      "Fetch packet larger than a cache line"
+    )
+    require(conf.idOffset + 1 + streamDepth <= 16, "Out of DRAM request IDs")
+    def STREAM_ID(i: Int) = (1 + i + conf.idOffset).U(4.W)
+    val nDramIds = conf.idOffset + 1 + streamDepth // IDs used on the port
+    val lineWidth = 32 - conf.nCacheLineWidth
 
-    // Memories (1 cycle latency)
-    val mem = SyncReadMem(nSets, Vec(nBytes, UInt(8.W)))
-    class TagEntry extends Bundle {
-        val valid = Bool()
-        val tag = UInt(tagWidth.W)
-    }
-    val tags = SyncReadMem(nSets, new TagEntry)
+    // Memories (1 cycle latency), one data array per way
+    val mem = Seq.fill(nWays)(SyncReadMem(nSets, Vec(nBytes, UInt(8.W))))
+    val tags = SyncReadMem(nSets, Vec(nWays, UInt(tagWidth.W)))
+    val valids = RegInit(VecInit(Seq.fill(nSets)(0.U(nWays.W))))
+
+    // Way Prediction & Replacement
+    val wayPred = RegInit(VecInit(Seq.fill(nSets)(0.U(wayBits.W))))
+    val repl = Module(new CacheReplacement(nSets, nWays, conf.replacement))
 
     // Helper functions
     def get_index(addr: UInt) =
@@ -50,8 +77,49 @@ class ICache(conf: CacheConfig) extends Module {
     def get_tag(addr: UInt) = addr(31, conf.nCacheLineWidth + conf.nSetsWidth)
     def get_offset(addr: UInt) = addr(conf.nCacheLineWidth - 1, 0)
 
+    // Stream Buffer
+    class StreamEntry extends Bundle {
+        val valid = Bool() // Belongs to the current stream
+        val line = UInt(lineWidth.W)
+        val sent = Bool()
+        val busy = Bool() // Sent, response not back yet
+        val ready = Bool()
+        val data = Vec(nBytes, UInt(8.W))
+    }
+    val stream = RegInit(
+      VecInit(Seq.fill(streamDepth)(0.U.asTypeOf(new StreamEntry)))
+    )
+    val streamActive = RegInit(false.B)
+    val streamNext = Reg(UInt(lineWidth.W))
+    val streamWaitIdx = Reg(UInt(log2Ceil(streamDepth).max(1).W))
+
+    // Array Writes (refills and stream buffer hits)
+    val arrays_wen = WireInit(false.B)
+    val arrays_line = WireInit(0.U(lineWidth.W))
+    val arrays_data = WireInit(VecInit(Seq.fill(nBytes)(0.U(8.W))))
+    val arrays_set = arrays_line(conf.nSetsWidth - 1, 0)
+    val setValids = valids(arrays_set)
+    val arrays_way = Mux(
+      setValids.andR,
+      repl.io.victim,
+      PriorityEncoder(~setValids)
+    )
+    repl.io.set := arrays_set
+    when(arrays_wen) {
+        for (w <- 0 until nWays) {
+            when(arrays_way === w.U) { mem(w).write(arrays_set, arrays_data) }
+        }
+        tags.write(
+          arrays_set,
+          VecInit(Seq.fill(nWays)(arrays_line(lineWidth - 1, conf.nSetsWidth))),
+          UIntToOH(arrays_way, nWays).asBools
+        )
+        valids(arrays_set) := setValids | UIntToOH(arrays_way, nWays)
+        wayPred(arrays_set) := arrays_way
+    }
+
     // State Machine
-    val sReady :: sRefill :: Nil = Enum(2)
+    val sReady :: sRefill :: sStreamWait :: Nil = Enum(3)
     val state = RegInit(sReady)
     val refillAddr = Reg(
       UInt(32.W)
@@ -61,61 +129,138 @@ class ICache(conf: CacheConfig) extends Module {
 
     io.events.hit := false.B
     io.events.miss := false.B
+    io.events.way := 0.U
+    io.events.prefetchIssued := false.B
+    io.events.prefetchUseful := false.B
+    io.events.wayMispredict := false.B
 
     // -----------------------------------------------------------
     // Stage 1: Request (Cycle 0)
     // -----------------------------------------------------------
 
     // We only accept requests if we are Ready (not refilling)
-    // AND if the previous cycle wasn't a miss (pipelining stall)
-    io.req.ready := (state === sReady)
+    // AND if the arrays are not being written this cycle
+    io.req.ready := (state === sReady) && !arrays_wen
 
     val reqValid = io.req.valid && io.req.ready
     val reqAddr = io.req.bits
+    val reqIndex = get_index(reqAddr)
+
+    // Forward declaration: way mispredict in Stage 2
+    val wayMiss = WireInit(false.B)
+    val hitWay = Wire(UInt(wayBits.W))
+    val s1_addr = RegNext(reqAddr)
+
+    // Predicted way, retrained by a mispredict of the same set this cycle
+    val predWay = Mux(
+      wayMiss && get_index(s1_addr) === reqIndex,
+      hitWay,
+      wayPred(reqIndex)
+    )
 
     // Access Memories
-    val tagRead = tags.read(get_index(reqAddr), reqValid)
-    val dataRead = mem.read(get_index(reqAddr), reqValid)
+    val tagRead = tags.read(reqIndex, reqValid)
+    val dataReads = mem.zipWithIndex.map { case (m, w) =>
+        m.read(reqIndex, reqValid && predWay === w.U)
+    }
 
     // Pipeline Register to match SRAM latency (Cycle 0 -> Cycle 1)
     val s1_valid = RegNext(reqValid, init = false.B)
-    val s1_addr = RegNext(reqAddr)
+    val s1_predWay = RegNext(predWay)
+    val dataRead = VecInit(dataReads)(s1_predWay)
 
     // -----------------------------------------------------------
     // Stage 2: Tag Check & Hit/Miss (Cycle 1)
     // -----------------------------------------------------------
 
-    val hit = s1_valid && tagRead.valid && (tagRead.tag === get_tag(s1_addr))
-    val miss = s1_valid && !hit
+    val s1_index = get_index(s1_addr)
+    val hitVec = VecInit(
+      Seq.tabulate(nWays)(w =>
+          valids(s1_index)(w) && tagRead(w) === get_tag(s1_addr)
+      )
+    )
+    val tagHit = s1_valid && hitVec.asUInt.orR
+    hitWay := OHToUInt(hitVec)
+    val hit = tagHit && hitWay === s1_predWay
+    val miss = s1_valid && !tagHit
+    wayMiss := tagHit && !hit
 
     io.events.hit := hit && !justRefilled
     io.events.miss := miss && (state === sReady)
+    io.events.way := hitWay
+    io.events.wayMispredict := wayMiss
     when(s1_valid) { justRefilled := false.B }
+    when(wayMiss) { wayPred(s1_index) := hitWay }
 
-    // If Hit: Present Data
-    val aligned_offset =
-        Cat(get_offset(s1_addr)(conf.nCacheLineWidth - 1, 2), 0.U(2.W))
-    val dataWord = Cat(
-      dataRead((aligned_offset + 3.U).asUInt),
-      dataRead((aligned_offset + 2.U).asUInt),
-      dataRead((aligned_offset + 1.U).asUInt),
-      dataRead(aligned_offset.asUInt)
+    // Replacement state follows hits and fills
+    repl.io.touch.valid := hit || arrays_wen
+    repl.io.touch.bits.set := Mux(arrays_wen, arrays_set, s1_index)
+    repl.io.touch.bits.way := Mux(arrays_wen, arrays_way, hitWay)
+
+    // If Hit: Present the fetch packet, slots before the address are masked
+    val nPackets = nBytes / (FETCH_PACKET_SIZE * 4)
+    val packets = dataRead.asTypeOf(
+      Vec(nPackets, Vec(FETCH_PACKET_SIZE, UInt(32.W)))
     )
+    val packetIdx =
+        if (nPackets > 1)
+            s1_addr(conf.nCacheLineWidth - 1, FETCH_PACKET_WIDTH + 2)
+        else 0.U
+    val slot = s1_addr(FETCH_PACKET_WIDTH + 1, 2)
 
     // Output Logic
     // Valid only if we hit.
     // If we missed, valid is low, and the Fetcher must retry later.
     io.resp.valid := hit
-    io.resp.bits := dataWord
+    io.resp.bits.insts := packets(packetIdx)
+    io.resp.bits.mask :=
+        (~0.U(FETCH_PACKET_SIZE.W) << slot)(FETCH_PACKET_SIZE - 1, 0)
 
     // -----------------------------------------------------------
     // Miss Handling & Refill
     // -----------------------------------------------------------
 
+    val s1_line = s1_addr(31, conf.nCacheLineWidth)
+    val streamMatchVec = stream.map(e => e.valid && e.line === s1_line)
+    val streamMatch = streamMatchVec.reduce(_ || _)
+    val streamMatchIdx = PriorityEncoder(streamMatchVec)
+
+    // Move a buffered line into the cache and free its slot
+    private def streamInstall(idx: UInt): Unit = {
+        val e = stream(idx)
+        arrays_wen := true.B
+        arrays_line := e.line
+        arrays_data := e.data
+        e.valid := false.B
+        io.events.prefetchUseful := true.B
+        justRefilled := true.B
+    }
+
     when(miss && state === sReady) {
-        state := sRefill
-        refillAddr := s1_addr // Snapshot address for DRAM only
-        refillSent := false.B
+        when(streamMatch) {
+            // Found in the stream buffer: not a miss to DRAM
+            io.events.miss := false.B
+            when(stream(streamMatchIdx).ready) {
+                streamInstall(streamMatchIdx)
+            }.otherwise {
+                streamWaitIdx := streamMatchIdx
+                state := sStreamWait
+            }
+        }.otherwise {
+            state := sRefill
+            refillAddr := s1_addr // Snapshot address for DRAM only
+            refillSent := false.B
+
+            // Restart the stream after the missing line
+            streamActive := true.B
+            streamNext := s1_line + 1.U
+            stream.foreach(_.valid := false.B)
+        }
+    }
+
+    when(state === sStreamWait && stream(streamWaitIdx).ready) {
+        streamInstall(streamWaitIdx)
+        state := sReady
     }
 
     // DRAM Request
@@ -125,29 +270,73 @@ class ICache(conf: CacheConfig) extends Module {
       0.U(conf.nCacheLineWidth.W)
     )
 
-    io.dram.req.valid := (state === sRefill) && !refillSent
-    io.dram.req.bits.id := RD_ID
-    io.dram.req.bits.addr := dram_addr
+    // The demand refill goes first, then stream slots waiting to be sent
+    val demandReq = (state === sRefill) && !refillSent
+    val streamSendVec = stream.map(e => e.valid && !e.sent)
+    val streamSendIdx = PriorityEncoder(streamSendVec)
+    val streamSend = streamSendVec.reduce(_ || _) && !demandReq
+
+    io.dram.req.valid := demandReq || streamSend
+    io.dram.req.bits.id := Mux(
+      demandReq,
+      RD_ID,
+      VecInit(Seq.tabulate(streamDepth)(STREAM_ID))(streamSendIdx)
+    )
+    io.dram.req.bits.addr := Mux(
+      demandReq,
+      dram_addr,
+      Cat(stream(streamSendIdx).line, 0.U(conf.nCacheLineWidth.W))
+    )
     io.dram.req.bits.isWr := false.B
     io.dram.req.bits.mask := 0.U
     io.dram.req.bits.data := 0.U
 
-    when(io.dram.req.fire) { refillSent := true.B }
+    when(io.dram.req.fire) {
+        when(demandReq) {
+            refillSent := true.B
+        }.otherwise {
+            stream(streamSendIdx).sent := true.B
+            stream(streamSendIdx).busy := true.B
+            io.events.prefetchIssued := true.B
+        }
+    }
+
+    // Keep the stream buffer full: a free slot takes the next line. A slot
+    // dropped by a restart is reused once its old response is back.
+    val streamFreeVec = stream.map(e => !e.valid && !e.busy)
+    val streamFreeIdx = PriorityEncoder(streamFreeVec)
+    when(
+      streamActive && streamFreeVec.reduce(_ || _) &&
+          !(miss && state === sReady && !streamMatch)
+    ) {
+        val e = stream(streamFreeIdx)
+        e.valid := true.B
+        e.line := streamNext
+        e.sent := false.B
+        e.ready := false.B
+        streamNext := streamNext + 1.U
+    }
 
     // DRAM Response
     io.dram.resp.ready := true.B
+    for (i <- 0 until streamDepth) {
+        when(io.dram.resp.valid && io.dram.resp.bits.id === STREAM_ID(i)) {
+            val e = stream(i)
+            e.busy := false.B
+            e.ready := true.B
+            e.data := VecInit(
+              Seq.tabulate(nBytes)(b => io.dram.resp.bits.data(8 * b + 7, 8 * b))
+            )
+        }
+    }
     when(io.dram.resp.valid && (io.dram.resp.bits.id === RD_ID)) {
         // Refill Cache Arrays
         val refill_data = io.dram.resp.bits.data
-        val refill_vec =
-            VecInit(Seq.tabulate(nBytes)(i => refill_data(8 * i + 7, 8 * i)))
-
-        mem.write(get_index(refillAddr), refill_vec)
-
-        val newTag = Wire(new TagEntry)
-        newTag.valid := true.B
-        newTag.tag := get_tag(refillAddr)
-        tags.write(get_index(refillAddr), newTag)
+        arrays_wen := true.B
+        arrays_line := refillAddr(31, conf.nCacheLineWidth)
+        arrays_data := VecInit(
+          Seq.tabulate(nBytes)(i => refill_data(8 * i + 7, 8 * i))
+        )
 
         // Go back to Ready.
         // The Fetcher is still holding the address, so next cycle it will request again
@@ -156,3 +345,12 @@ class ICache(conf: CacheConfig) extends Module {
         justRefilled := true.B
     }
 }
+
+object ICache {
+    // 4 KiB 4-way, 16-byte lines
+    val defaultCache = CacheConfig(
+      nSetsWidth = 6,
+      nCacheLineWidth = 4,
+      nWays = 4
+    )
+}
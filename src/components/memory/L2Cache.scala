@@ -0,0 +1,290 @@
+package components.memory
+
+import chisel3._
+import chisel3.util._
+
+class L2Events extends Bundle {
+    val hit = Output(Bool())
+    val miss = Output(Bool())
+    // A valid line was replaced by a miss
+    val eviction = Output(Bool())
+}
+
+/** Unified second-level cache
+  *
+  * Sits between the L1 interconnect and DRAM and speaks `SimpleMemIO` on both
+  * sides. A line is one bus beat. The cache is blocking, write-back and
+  * write-allocate, and neither inclusive nor exclusive: L1 refills and
+  * writebacks allocate lines here, but an L2 eviction leaves the L1s alone.
+  *
+  * A request is looked up the cycle after it is accepted and answered with its
+  * own ID. A miss writes back a dirty victim, then reads the line from DRAM.
+  * A whole-line write that misses is allocated without reading DRAM.
+  *
+  * @param conf
+  *   Geometry and replacement policy. Only `nSetsWidth`, `nCacheLineWidth`,
+  *   `nWays` and `replacement` are used.
+  * @param memConf
+  *   Bus parameters, shared by both sides
+  */
+class L2Cache(conf: CacheConfig, memConf: MemConfig) extends Module {
+    val io = IO(new Bundle {
+        val upstream = Flipped(new SimpleMemIO(memConf))
+        val dram = new SimpleMemIO(memConf)
+        val flush = new CacheFlush
+        val events = new L2Events
+    })
+
+    val nSets = 1 << conf.nSetsWidth
+    val nBytes = 1 << conf.nCacheLineWidth
+    val nWays = conf.nWays
+    val wayBits = log2Ceil(nWays) max 1
+    val tagWidth = memConf.addrWidth - conf.nSetsWidth - conf.nCacheLineWidth
+    require(memConf.dataWidth == nBytes * 8, "L2 lines must be one bus beat")
+
+    // The L2 is the only DRAM master, so it picks its own IDs
+    val RD_ID = 0.U(memConf.idWidth.W)
+    val WR_ID = 1.U(memConf.idWidth.W)
+
+    // Memories (1 cycle latency); valid and dirty bits live in registers
+    val tags = SyncReadMem(nSets, Vec(nWays, UInt(tagWidth.W)))
+    val data = SyncReadMem(nSets, Vec(nWays, UInt(memConf.dataWidth.W)))
+    val valids = RegInit(VecInit(Seq.fill(nSets)(0.U(nWays.W))))
+    val dirtys = RegInit(VecInit(Seq.fill(nSets)(0.U(nWays.W))))
+    val repl = Module(new CacheReplacement(nSets, nWays, conf.replacement))
+
+    // Helper functions
+    def get_index(addr: UInt) =
+        addr(conf.nCacheLineWidth + conf.nSetsWidth - 1, conf.nCacheLineWidth)
+    def get_tag(addr: UInt) =
+        addr(memConf.addrWidth - 1, conf.nCacheLineWidth + conf.nSetsWidth)
+    def merge(old: UInt, wdata: UInt, mask: UInt) = {
+        val bits = FillInterleaved(8, mask)
+        (old & ~bits) | (wdata & bits)
+    }
+
+    // State Machine
+    val sIdle :: sLookup :: sWriteBack :: sRefill :: sRespond :: sFlushRead :: sFlushCheck :: sFlushWrite :: Nil =
+        Enum(8)
+    val state = RegInit(sIdle)
+
+    val req = Reg(new MemRequest(memConf))
+    val way = Reg(UInt(wayBits.W))
+    val respData = Reg(UInt(memConf.dataWidth.W))
+    val victimAddr = Reg(UInt(memConf.addrWidth.W))
+    val victimData = Reg(UInt(memConf.dataWidth.W))
+    val readSent = RegInit(false.B)
+    // Writebacks not acknowledged yet. DRAM holds 16 requests in flight, and
+    // no more writebacks are sent once the count saturates.
+    val wbLimit = 16
+    val wbInFlight = RegInit(0.U(log2Ceil(wbLimit + 1).W))
+    val wbCanSend = wbInFlight =/= wbLimit.U
+
+    val flushIndex = RegInit(0.U(conf.nSetsWidth.W))
+    val flushed = RegInit(false.B)
+
+    io.events.hit := false.B
+    io.events.miss := false.B
+    io.events.eviction := false.B
+
+    // Requests are held off while a flush is requested
+    io.upstream.req.ready := state === sIdle && !io.flush.req
+    val accept = io.upstream.req.fire
+
+    // Array Reads: the accepted request, or the set being flushed
+    val readIndex = Mux(
+      state === sFlushRead,
+      flushIndex,
+      get_index(io.upstream.req.bits.addr)
+    )
+    val readEn = accept || state === sFlushRead
+    val tagRead = tags.read(readIndex, readEn)
+    val dataRead = data.read(readIndex, readEn)
+
+    // Array Writes, for the line of `req`
+    val arrays_wen = WireInit(false.B)
+    val arrays_way = WireInit(way)
+    val arrays_data = WireInit(0.U(memConf.dataWidth.W))
+    val set = get_index(req.addr)
+    when(arrays_wen) {
+        val wayMask = UIntToOH(arrays_way, nWays).asBools
+        tags.write(set, VecInit(Seq.fill(nWays)(get_tag(req.addr))), wayMask)
+        data.write(set, VecInit(Seq.fill(nWays)(arrays_data)), wayMask)
+    }
+
+    // Replacement state follows hits and fills
+    val touch = WireInit(false.B)
+    repl.io.touch.valid := touch
+    repl.io.touch.bits.set := set
+    repl.io.touch.bits.way := arrays_way
+    repl.io.set := set
+
+    // DRAM Interface defaults
+    io.dram.req.valid := false.B
+    io.dram.req.bits.id := RD_ID
+    io.dram.req.bits.addr := Cat(
+      req.addr(memConf.addrWidth - 1, conf.nCacheLineWidth),
+      0.U(conf.nCacheLineWidth.W)
+    )
+    io.dram.req.bits.data := 0.U
+    io.dram.req.bits.isWr := false.B
+    io.dram.req.bits.mask := 0.U
+    io.dram.resp.ready := true.B
+
+    val wbAck = io.dram.resp.valid && io.dram.resp.bits.id === WR_ID
+    val wbSent = io.dram.req.fire && io.dram.req.bits.isWr
+    wbInFlight := wbInFlight + wbSent.asUInt - wbAck.asUInt
+
+    // -----------------------------------------------------------
+    // Lookup
+    // -----------------------------------------------------------
+
+    when(accept) {
+        req := io.upstream.req.bits
+        state := sLookup
+    }
+
+    val setValids = valids(set)
+    val hitVec = VecInit(
+      Seq.tabulate(nWays)(w =>
+          setValids(w) && tagRead(w) === get_tag(req.addr)
+      )
+    )
+    val hit = hitVec.asUInt.orR
+    val hitWay = OHToUInt(hitVec)
+    val victim = Mux(
+      setValids.andR,
+      repl.io.victim,
+      PriorityEncoder(~setValids)
+    )
+
+    when(state === sLookup) {
+        io.events.hit := hit
+        io.events.miss := !hit
+        when(hit) {
+            arrays_way := hitWay
+            touch := true.B
+            respData := dataRead(hitWay)
+            when(req.isWr) {
+                arrays_wen := true.B
+                arrays_data := merge(dataRead(hitWay), req.data, req.mask)
+                dirtys(set) := dirtys(set) | UIntToOH(hitWay, nWays)
+            }
+            state := sRespond
+        }.otherwise {
+            val evict = setValids(victim)
+            io.events.eviction := evict
+            way := victim
+            victimAddr :=
+                Cat(tagRead(victim), set, 0.U(conf.nCacheLineWidth.W))
+            victimData := dataRead(victim)
+            // The victim is invalid until the new line is written
+            valids(set) := setValids & ~UIntToOH(victim, nWays)
+            readSent := false.B
+            state := Mux(evict && dirtys(set)(victim), sWriteBack, sRefill)
+        }
+    }
+
+    // -----------------------------------------------------------
+    // Miss Handling
+    // -----------------------------------------------------------
+
+    // Write back the dirty victim first. DRAM applies a write when it
+    // accepts it, so the refill can follow right away.
+    private def sendWriteBack(): Unit = {
+        io.dram.req.valid := wbCanSend
+        io.dram.req.bits.id := WR_ID
+        io.dram.req.bits.addr := victimAddr
+        io.dram.req.bits.data := victimData
+        io.dram.req.bits.isWr := true.B
+        io.dram.req.bits.mask := Fill(nBytes, 1.U(1.W))
+    }
+
+    when(state === sWriteBack) {
+        sendWriteBack()
+        when(io.dram.req.fire) { state := sRefill }
+    }
+
+    // Write the missing line into `way`, with the request's data merged in
+    private def install(line: UInt): Unit = {
+        val wayMask = UIntToOH(way, nWays)
+        arrays_wen := true.B
+        arrays_data := Mux(req.isWr, merge(line, req.data, req.mask), line)
+        touch := true.B
+        valids(set) := valids(set) | wayMask
+        dirtys(set) := Mux(
+          req.isWr,
+          dirtys(set) | wayMask,
+          dirtys(set) & ~wayMask
+        )
+        respData := line
+        state := sRespond
+    }
+
+    when(state === sRefill) {
+        when(req.isWr && req.mask.andR) {
+            install(req.data)
+        }.otherwise {
+            io.dram.req.valid := !readSent
+            when(io.dram.req.fire) { readSent := true.B }
+            when(io.dram.resp.valid && io.dram.resp.bits.id === RD_ID) {
+                install(io.dram.resp.bits.data)
+            }
+        }
+    }
+
+    // Response
+    io.upstream.resp.valid := state === sRespond
+    io.upstream.resp.bits.id := req.id
+    io.upstream.resp.bits.data := respData
+    when(io.upstream.resp.fire) { state := sIdle }
+
+    // -----------------------------------------------------------
+    // Flush: walk every set, writing dirty lines back one at a time
+    // -----------------------------------------------------------
+
+    when(state === sIdle && io.flush.req && !flushed) {
+        flushIndex := 0.U
+        state := sFlushRead
+    }
+
+    when(state === sFlushRead) {
+        // Clean sets are skipped without waiting for the read
+        when((valids(flushIndex) & dirtys(flushIndex)) === 0.U) {
+            val lastSet = flushIndex === (nSets - 1).U
+            flushIndex := flushIndex + 1.U
+            state := Mux(lastSet, sIdle, sFlushRead)
+            when(lastSet) { flushed := true.B }
+        }.otherwise {
+            state := sFlushCheck
+        }
+    }
+
+    when(state === sFlushCheck) {
+        val dirtyVec = valids(flushIndex) & dirtys(flushIndex)
+        val w = PriorityEncoder(dirtyVec)
+        victimAddr :=
+            Cat(tagRead(w), flushIndex, 0.U(conf.nCacheLineWidth.W))
+        victimData := dataRead(w)
+        dirtys(flushIndex) := dirtys(flushIndex) & ~UIntToOH(w, nWays)
+        state := sFlushWrite
+    }
+
+    // The set is read again until none of its lines is dirty
+    when(state === sFlushWrite) {
+        sendWriteBack()
+        when(io.dram.req.fire) { state := sFlushRead }
+    }
+
+    when(!io.flush.req) { flushed := false.B }
+    io.flush.done := flushed && state === sIdle && wbInFlight === 0.U
+}
+
+object L2Cache {
+    // 32 KiB 8-way, 16-byte lines
+    val defaultCache = CacheConfig(
+      nSetsWidth = 8,
+      nCacheLineWidth = 4,
+      nWays = 8
+    )
+}
@@ -0,0 +1,132 @@
+package components.memory
+
+import chisel3._
+import chisel3.util._
+
+/** Arbitration policy of a memory interconnect
+  *
+  * Includes: `RoundRobin`, `Fixed` (lower master index first), `ReadsFirst`
+  * (reads before writes, then lower master index first).
+  */
+sealed trait ArbiterPolicy
+object ArbiterPolicy {
+    case object RoundRobin extends ArbiterPolicy
+    case object Fixed extends ArbiterPolicy
+    case object ReadsFirst extends ArbiterPolicy
+
+    def fromString(name: String): ArbiterPolicy = name.toLowerCase match {
+        case "rr" | "roundrobin" => RoundRobin
+        case "fixed"             => Fixed
+        case "readsfirst"        => ReadsFirst
+        case other =>
+            throw new IllegalArgumentException(
+              s"Unknown arbitration policy: $other"
+            )
+    }
+}
+
+/** N-master memory interconnect
+  *
+  * Every master numbers its requests from ID 0 up to `nIds(i) - 1`. The
+  * interconnect gives each master its own range of IDs on the memory side,
+  * in master order, and translates IDs both ways. Responses are routed by
+  * that range into one queue per master, so a master that is not ready only
+  * holds up the memory side once its queue is full.
+  *
+  * @param conf
+  *   Bus parameters, shared by all ports
+  * @param nIds
+  *   Number of request IDs each master uses
+  * @param policy
+  *   How to pick among masters with a request
+  * @param respDepth
+  *   Entries of each master's response queue
+  */
+class MemInterconnect(
+    conf: MemConfig,
+    nIds: Seq[Int],
+    policy: ArbiterPolicy = ArbiterPolicy.RoundRobin,
+    respDepth: Int = 2
+) extends Module {
+    val n = nIds.length
+    val bases = nIds.scanLeft(0)(_ + _)
+    require(n >= 1)
+    require(bases.last <= (1 << conf.idWidth), "Out of memory request IDs")
+
+    val io = IO(new Bundle {
+        val masters = Vec(n, Flipped(new SimpleMemIO(conf)))
+        val mem = new SimpleMemIO(conf)
+    })
+
+    // -----------------------------------------------------------
+    // Requests
+    // -----------------------------------------------------------
+
+    val valids = VecInit(io.masters.map(_.req.valid))
+    val reads = VecInit(io.masters.map(m => m.req.valid && !m.req.bits.isWr))
+    val chosen = Wire(UInt((log2Ceil(n) max 1).W))
+    policy match {
+        case ArbiterPolicy.RoundRobin =>
+            val last = RegInit(0.U((log2Ceil(n) max 1).W))
+            val after = VecInit(
+              valids.zipWithIndex.map { case (v, i) => v && i.U > last }
+            )
+            chosen := Mux(
+              after.asUInt.orR,
+              PriorityEncoder(after),
+              PriorityEncoder(valids)
+            )
+            when(io.mem.req.fire) { last := chosen }
+        case ArbiterPolicy.Fixed =>
+            chosen := PriorityEncoder(valids)
+        case ArbiterPolicy.ReadsFirst =>
+            chosen := Mux(
+              reads.asUInt.orR,
+              PriorityEncoder(reads),
+              PriorityEncoder(valids)
+            )
+    }
+
+    val idBase = VecInit(bases.init.map(_.U(conf.idWidth.W)))
+    io.mem.req.valid := valids.asUInt.orR
+    io.mem.req.bits := io.masters(chosen).req.bits
+    io.mem.req.bits.id := io.masters(chosen).req.bits.id + idBase(chosen)
+    for (i <- 0 until n) {
+        io.masters(i).req.ready := io.mem.req.ready && chosen === i.U
+        chisel3.assert(
+          !io.masters(i).req.valid || io.masters(i).req.bits.id < nIds(i).U,
+          s"Master $i used an ID outside its range"
+        )
+    }
+
+    // -----------------------------------------------------------
+    // Responses
+    // -----------------------------------------------------------
+
+    val respId = io.mem.resp.bits.id
+    val owner = (0 until n).map(i =>
+        respId >= bases(i).U && respId < bases(i + 1).U
+    )
+    val respQueues = Seq.fill(n)(
+      Module(
+        new Queue(
+          new MemResponse(conf),
+          entries = respDepth,
+          pipe = false,
+          flow = true
+        )
+      )
+    )
+    for (i <- 0 until n) {
+        val q = respQueues(i)
+        q.io.enq.valid := io.mem.resp.valid && owner(i)
+        q.io.enq.bits.id := respId - bases(i).U
+        q.io.enq.bits.data := io.mem.resp.bits.data
+        io.masters(i).resp <> q.io.deq
+    }
+    // A response outside every range is dropped
+    val ownerReady = owner.zip(respQueues).map { case (o, q) =>
+        o && q.io.enq.ready
+    }
+    io.mem.resp.ready := !owner.reduce(_ || _) || ownerReady.reduce(_ || _)
+}
@@ -11,25 +11,41 @@ import utility.CycleAwareModule
   *
   * This module capsulates how memory requests are handled. It is connected to
   * the LSU (upstream) and the DRAM (downstream).
+  *
+  * Requests complete out of order: a cache hit may be answered before an
+  * earlier miss. Each response carries the tag of its request, and the
+  * request's metadata is kept in a table indexed by that tag.
+  *
+  * @param cacheConf
+  *   Data cache configuration
+  * @param prefetchConf
+  *   Stride prefetcher configuration, None to fetch on demand only
   */
-class MemorySubsystem extends Module {
+class MemorySubsystem(
+    val cacheConf: CacheConfig = MemorySubsystem.defaultCache,
+    val prefetchConf: Option[StridePrefetchConfig] = Some(
+      StridePrefetchConfig()
+    )
+) extends Module {
     // IO Definition
     val io = IO(new Bundle {
-        val upstream = Flipped(new MemoryRequest)
+        val upstream = Flipped(new TaggedMemoryRequest)
         val mmio = new MemoryRequest
         val dram = new SimpleMemIO(
           MemConfig(idWidth = 4, addrWidth = 32, dataWidth = 128)
         )
-        val cacheEvents = new CacheEvents
+        val cacheEvents = new CacheEvents(cacheConf.nWays)
+        val flush = new CacheFlush
     })
 
     // Component Instantiation
-    val cacheConf = CacheConfig(nSetsWidth = 6, nCacheLineWidth = 4)
     val cache = Module(new Cache(cacheConf))
     cache.io.dram <> io.dram
+    val nDramIds = cache.nDramIds
     io.cacheEvents := cache.io.events
+    cache.io.flush <> io.flush
 
-    val reqInfoQueue = Module(new Queue(new LoadStoreAction, entries = 4))
+    val reqInfo = Reg(Vec(Derived.MEM_TAG_COUNT, new LoadStoreAction))
 
     // Request Routing
     val isMMIO = io.upstream.req.bits.addr(31) === 1.U
@@ -53,17 +69,30 @@ class MemorySubsystem extends Module {
     cache.io.port.wdata := req.data
     cache.io.port.wmask := wmask
     cache.io.port.isWr := !req.isLoad
+    cache.io.port.id := req.tag
+
+    // Prefetching: trained on the accepted cache accesses
+    prefetchConf match {
+        case Some(c) =>
+            val prefetcher =
+                Module(new StridePrefetcher(c, cacheConf.nCacheLineWidth))
+            prefetcher.io.access.valid := io.upstream.req.fire && !isMMIO
+            prefetcher.io.access.bits := req.addr
+            cache.io.prefetch <> prefetcher.io.prefetch
+        case None =>
+            cache.io.prefetch.valid := false.B
+            cache.io.prefetch.bits := DontCare
+    }
 
-    // Track Metadata (Enqueue if either path fires)
+    // Track Metadata (Record if either path fires)
     val targetReady = Mux(isMMIO, io.mmio.req.ready, cache.io.port.ready)
-    io.upstream.req.ready := targetReady && reqInfoQueue.io.enq.ready
+    io.upstream.req.ready := targetReady
 
-    reqInfoQueue.io.enq.valid := io.upstream.req.fire
-    reqInfoQueue.io.enq.bits := req
+    when(io.upstream.req.fire) { reqInfo(req.tag) := req }
 
     // Response Routing
     // Merge responses from Cache and MMIO into one stream
-    val respArb = Module(new Arbiter(UInt(32.W), 2))
+    val respArb = Module(new Arbiter(new MemoryResponse, 2))
 
     // Port 0: Cache Response (High Priority)
     /*
@@ -71,14 +100,25 @@ class MemorySubsystem extends Module {
      *   If Cache response has no backpressure (no 'ready'), we assume it connects valid-to-valid
      */
     respArb.io.in(0).valid := cache.io.port.respValid
-    respArb.io.in(0).bits := cache.io.port.rdata
+    respArb.io.in(0).bits.data := cache.io.port.rdata
+    respArb.io.in(0).bits.tag := cache.io.port.respId
 
     // Port 1: MMIO Response
-    respArb.io.in(1) <> io.mmio.resp
+    // The router answers one cycle after the request and cannot wait, so its
+    // responses are queued while the cache has priority
+    val mmioTag = RegNext(req.tag)
+    val mmioResp = Module(
+      new Queue(new MemoryResponse, entries = Derived.MEM_TAG_COUNT)
+    )
+    mmioResp.io.enq.valid := io.mmio.resp.valid
+    mmioResp.io.enq.bits.data := io.mmio.resp.bits
+    mmioResp.io.enq.bits.tag := mmioTag
+    io.mmio.resp.ready := mmioResp.io.enq.ready
+    respArb.io.in(1) <> mmioResp.io.deq
 
     // Data Formatting & Output
-    val info = reqInfoQueue.io.deq.bits
-    val rawData = respArb.io.out.bits
+    val info = reqInfo(respArb.io.out.bits.tag)
+    val rawData = respArb.io.out.bits.data
 
     // Byte/Halfword Alignment & Sign Extension
     val addrOffset = info.addr(1, 0)
@@ -104,14 +144,17 @@ class MemorySubsystem extends Module {
 
     // Connect Arbiter output to Upstream
     io.upstream.resp.valid := respArb.io.out.valid
-    io.upstream.resp.bits := formattedData
+    io.upstream.resp.bits.data := formattedData
+    io.upstream.resp.bits.tag := respArb.io.out.bits.tag
 
     // Backpressure flow
     respArb.io.out.ready := io.upstream.resp.ready
 
-    // Dequeue metadata only when a response is successfully sent upstream
-    reqInfoQueue.io.deq.ready := io.upstream.resp.fire
-
     private def signExtByte(v: UInt) = Cat(Fill(24, v(7)), v)
     private def signExtendHalfWord(v: UInt) = Cat(Fill(16, v(15)), v)
 }
+
+object MemorySubsystem {
+    // 1 KiB direct-mapped, 16-byte lines
+    val defaultCache = CacheConfig(nSetsWidth = 6, nCacheLineWidth = 4)
+}
@@ -0,0 +1,119 @@
+package components.memory
+
+import chisel3._
+import chisel3.util._
+
+/** Stride prefetcher parameters
+  *
+  * @param nEntries
+  *   Number of streams tracked at once
+  * @param regionWidth
+  *   log2 of the region size; accesses in one region train the same entry
+  * @param distance
+  *   How many strides ahead to prefetch, a power of two
+  */
+case class StridePrefetchConfig(
+    nEntries: Int = 8,
+    regionWidth: Int = 12,
+    distance: Int = 4
+)
+
+/** Address-indexed stride prefetcher
+  *
+  * Every demand access trains the entry of its region with the distance from
+  * the previous access. Once the same stride has been seen twice in a row,
+  * each access requests the line `distance` strides ahead, unless it is the
+  * line of the access itself or the last line requested for the entry.
+  *
+  * The cache only takes prefetches in cycles without a demand access, so the
+  * request is held in a pending register and offered from there. A newer
+  * request replaces one that has not been taken yet. The entry remembers the
+  * line once the cache accepts it.
+  *
+  * @param conf
+  *   Prefetcher parameters
+  * @param nCacheLineWidth
+  *   log2 of the cache line size in bytes
+  */
+class StridePrefetcher(conf: StridePrefetchConfig, nCacheLineWidth: Int)
+    extends Module {
+    require(isPow2(conf.distance), "distance must be a power of two")
+
+    val io = IO(new Bundle {
+        val access = Flipped(Valid(UInt(32.W)))
+        val prefetch = Decoupled(UInt(32.W))
+    })
+
+    val regionTagWidth = 32 - conf.regionWidth
+    val strideWidth = conf.regionWidth + 1
+
+    class Entry extends Bundle {
+        val valid = Bool()
+        val region = UInt(regionTagWidth.W)
+        val lastAddr = UInt(32.W)
+        val stride = SInt(strideWidth.W)
+        val confidence = UInt(2.W)
+        val lastPrefetch = UInt((32 - nCacheLineWidth).W)
+    }
+
+    val entries = RegInit(
+      VecInit(Seq.fill(conf.nEntries)(0.U.asTypeOf(new Entry)))
+    )
+    val victim = Counter(conf.nEntries)
+
+    val addr = io.access.bits
+    val region = addr(31, conf.regionWidth)
+    val hitVec = entries.map(e => e.valid && e.region === region)
+    val hit = hitVec.reduce(_ || _)
+    val e = entries(PriorityEncoder(hitVec))
+
+    val stride = (addr.asSInt - e.lastAddr.asSInt)(strideWidth - 1, 0).asSInt
+    val sameStride = stride === e.stride && stride =/= 0.S
+    val confidence = Mux(
+      sameStride,
+      Mux(e.confidence === 3.U, 3.U, e.confidence + 1.U),
+      Mux(e.confidence === 0.U, 0.U, e.confidence - 1.U)
+    )
+
+    // Request waiting for an idle cache cycle
+    val pending = RegInit(false.B)
+    val pendingLine = Reg(UInt((32 - nCacheLineWidth).W))
+    val pendingEntry = Reg(UInt(log2Ceil(conf.nEntries).max(1).W))
+
+    val target = (addr.asSInt + (stride << log2Ceil(conf.distance))).asUInt
+    val targetLine = target(31, nCacheLineWidth)
+    val issue = io.access.valid && hit && sameStride && confidence >= 2.U &&
+        targetLine =/= addr(31, nCacheLineWidth) &&
+        targetLine =/= e.lastPrefetch &&
+        !(pending && pendingLine === targetLine)
+
+    io.prefetch.valid := pending
+    io.prefetch.bits := Cat(pendingLine, 0.U(nCacheLineWidth.W))
+
+    when(io.prefetch.fire) {
+        entries(pendingEntry).lastPrefetch := pendingLine
+        pending := false.B
+    }
+    when(issue) {
+        pending := true.B
+        pendingLine := targetLine
+        pendingEntry := PriorityEncoder(hitVec)
+    }
+
+    when(io.access.valid) {
+        when(hit) {
+            e.lastAddr := addr
+            e.confidence := confidence
+            when(!sameStride) { e.stride := stride }
+        }.otherwise {
+            val n = entries(victim.value)
+            n.valid := true.B
+            n.region := region
+            n.lastAddr := addr
+            n.stride := 0.S
+            n.confidence := 0.U
+            n.lastPrefetch := 0.U
+            victim.inc()
+        }
+    }
+}
@@ -0,0 +1,113 @@
+package components.memory
+
+import chisel3._
+import chisel3.util._
+import chisel3.util.random.LFSR
+
+/** Replacement policy of a set-associative cache
+  *
+  * Includes: `LRU`, `PLRU` (tree pseudo-LRU), `Random`.
+  */
+sealed trait ReplacementPolicy
+object ReplacementPolicy {
+    case object LRU extends ReplacementPolicy
+    case object PLRU extends ReplacementPolicy
+    case object Random extends ReplacementPolicy
+
+    def fromString(name: String): ReplacementPolicy = name.toLowerCase match {
+        case "lru"    => LRU
+        case "plru"   => PLRU
+        case "random" => Random
+        case other =>
+            throw new IllegalArgumentException(
+              s"Unknown replacement policy: $other"
+            )
+    }
+}
+
+/** Replacement state for every set of a cache
+  *
+  * The state is kept in registers, so the victim of a set is available in the
+  * same cycle as the tag lookup.
+  *
+  * @param nSets
+  *   Number of sets
+  * @param nWays
+  *   Number of ways, a power of two
+  * @param policy
+  *   Replacement policy
+  */
+class CacheReplacement(nSets: Int, nWays: Int, policy: ReplacementPolicy)
+    extends Module {
+    require(isPow2(nWays), "nWays must be a power of two")
+    private val wayBits = log2Ceil(nWays) max 1
+
+    val io = IO(new Bundle {
+        // Mark a way as most recently used
+        val touch = Flipped(Valid(new Bundle {
+            val set = UInt(log2Ceil(nSets).W)
+            val way = UInt(wayBits.W)
+        }))
+        // Way to evict from `set`
+        val set = Input(UInt(log2Ceil(nSets).W))
+        val victim = Output(UInt(wayBits.W))
+    })
+
+    if (nWays == 1) {
+        io.victim := 0.U
+    } else {
+        policy match {
+            case ReplacementPolicy.LRU =>
+                // Age of each way, 0 = most recently used. Ages of a set are
+                // always a permutation of 0 until nWays.
+                val ages = RegInit(
+                  VecInit(
+                    Seq.fill(nSets)(
+                      VecInit(Seq.tabulate(nWays)(_.U(wayBits.W)))
+                    )
+                  )
+                )
+                when(io.touch.valid) {
+                    val setAges = ages(io.touch.bits.set)
+                    val old = setAges(io.touch.bits.way)
+                    for (w <- 0 until nWays) {
+                        when(w.U === io.touch.bits.way) {
+                            setAges(w) := 0.U
+                        }.elsewhen(setAges(w) < old) {
+                            setAges(w) := setAges(w) + 1.U
+                        }
+                    }
+                }
+                io.victim := PriorityEncoder(
+                  ages(io.set).map(_ === (nWays - 1).U)
+                )
+
+            case ReplacementPolicy.PLRU =>
+                // Binary tree in heap order: node i has children 2i+1, 2i+2.
+                // A node bit points to the half to evict next (0 = lower).
+                val levels = log2Ceil(nWays)
+                val trees = RegInit(VecInit(Seq.fill(nSets)(0.U((nWays - 1).W))))
+                when(io.touch.valid) {
+                    val bits = VecInit(trees(io.touch.bits.set).asBools)
+                    var node = 0.U(levels.W)
+                    for (l <- 0 until levels) {
+                        val dir = io.touch.bits.way(levels - 1 - l)
+                        bits(node) := !dir
+                        node = ((node << 1) + 1.U + dir)(levels - 1, 0)
+                    }
+                    trees(io.touch.bits.set) := bits.asUInt
+                }
+                val tree = trees(io.set)
+                var node = 0.U(levels.W)
+                val path = Wire(Vec(levels, Bool()))
+                for (l <- 0 until levels) {
+                    path(l) := tree(node)
+                    node = ((node << 1) + 1.U + path(l))(levels - 1, 0)
+                }
+                io.victim := Cat(path)
+
+            case ReplacementPolicy.Random =>
+                io.victim := LFSR(16)(wayBits - 1, 0)
+        }
+    }
+}
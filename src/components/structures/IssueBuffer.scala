@@ -21,6 +21,7 @@ class BRUInfo extends Bundle {
     val predict = Bool()
     val predictedTarget = UInt(32.W)
     val rasSP = UInt(RAS_WIDTH.W)
+    val bpMeta = new BranchPredictorMeta
 }
 
 class IssueBufferEntry[T <: Data](gen: T) extends Bundle {
@@ -0,0 +1,368 @@
+package components.structures
+
+import chisel3._
+import chisel3.util._
+import common.Configurables._
+import common._
+import utility.CycleAwareModule
+
+/** Entry issued by the load or store queue to the LSU pipeline
+  *
+  * @param ldqEntries
+  *   Number of entries in the load queue
+  * @param stqEntries
+  *   Number of entries in the store queue
+  */
+class LSUIssueBundle(ldqEntries: Int, stqEntries: Int) extends Bundle {
+    val bits = new SequentialBufferEntry(new LoadStoreInfo)
+    val ldqIdx = UInt(log2Ceil(ldqEntries).W)
+    // Stores: their own slot. Loads: the store queue tail at dispatch, so
+    // every store before it is older than the load.
+    val stqPtr = UInt((log2Ceil(stqEntries) + 1).W)
+}
+
+class StoreQueueEntry extends Bundle {
+    val bits = new SequentialBufferEntry(new LoadStoreInfo)
+    val addr = UInt(32.W)
+    val data = UInt(32.W)
+    // Address is known, and the store has been broadcast
+    val addrValid = Bool()
+    val dataValid = Bool()
+    val committed = Bool()
+}
+
+/** Store-to-load forwarding lookup, answered in the same cycle */
+class StoreForwardIO(stqEntries: Int) extends Bundle {
+    val addr = Input(UInt(32.W))
+    val info = Input(new LoadStoreInfo)
+    val stqPtr = Input(UInt((log2Ceil(stqEntries) + 1).W))
+
+    // Lanes of the load's word written by older stores, and their bytes
+    val mask = Output(UInt(4.W))
+    val data = Output(UInt(32.W))
+    // Lanes whose youngest older store does not have its data yet
+    val pending = Output(UInt(4.W))
+    // Some older store has not been sent to memory yet
+    val older = Output(Bool())
+}
+
+object StoreQueue {
+
+    /** Byte lanes of the word at `addr(31, 2)` accessed by an operation
+      *
+      * Lanes follow the cache: a store of width `w` at byte offset `o` writes
+      * lanes `w << o` from the same lanes of its data.
+      */
+    def laneMask(info: LoadStoreInfo, addr: UInt): UInt = {
+        val width = MuxLookup(info.opWidth, 15.U(4.W))(
+          Seq(
+            MemOpWidth.BYTE -> 1.U(4.W),
+            MemOpWidth.HALFWORD -> 3.U(4.W)
+          )
+        )
+        (width << addr(1, 0))(3, 0)
+    }
+}
+
+/** Store Queue
+  *
+  * Holds every store from dispatch until it is sent to memory, in program
+  * order. Stores are issued in order once their base register is ready, and
+  * the LSU writes the address back with `resolve`, so younger loads do not
+  * wait for late store data. The data comes with `resolve` if it was ready at
+  * issue; otherwise it is taken from the broadcast that wakes it. An entry is
+  * marked committed when the ROB head reaches it, and the committed head
+  * leaves through `drain` once its data is known. Flushes drop the killed
+  * stores, which are always the youngest ones.
+  *
+  * Pointers carry one wrap bit above the slot index.
+  *
+  * @param entries
+  *   Number of entries, a power of two
+  * @param ldqEntries
+  *   Number of entries in the load queue
+  */
+class StoreQueue(entries: Int, ldqEntries: Int) extends CycleAwareModule {
+    require(isPow2(entries) && entries > 1, "entries must be a power of two")
+    val idxWidth = log2Ceil(entries)
+    val ptrWidth = idxWidth + 1
+
+    val io = IO(new Bundle {
+        val in = Flipped(Decoupled(new SequentialBufferEntry(new LoadStoreInfo)))
+        val broadcast = Input(Valid(new BroadcastBundle()))
+        val flush = Input(new FlushBundle)
+        val robHead = Input(UInt(ROB_WIDTH.W))
+
+        val issue = Decoupled(new LSUIssueBundle(ldqEntries, entries))
+        val resolve = Flipped(Valid(new Bundle {
+            val ptr = UInt(ptrWidth.W)
+            val addr = UInt(32.W)
+            val data = UInt(32.W)
+            val dataValid = Bool() // The store was issued with its data ready
+        }))
+        val drain = Decoupled(new StoreQueueEntry)
+        val fwd = new StoreForwardIO(entries)
+
+        val head = Output(UInt(ptrWidth.W))
+        val tail = Output(UInt(ptrWidth.W))
+        val addrValid = Output(Vec(entries, Bool()))
+        val count = Output(UInt(log2Ceil(entries + 1).W))
+    })
+
+    val buffer = Reg(Vec(entries, new StoreQueueEntry))
+    val head = RegInit(0.U(ptrWidth.W))
+    val tail = RegInit(0.U(ptrWidth.W))
+    val issuePtr = RegInit(0.U(ptrWidth.W))
+
+    def slot(ptr: UInt) = ptr(idxWidth - 1, 0)
+    // Position of slot `i` counted from the head
+    def age(i: Int) = (i.U(idxWidth.W) - slot(head))(idxWidth - 1, 0)
+
+    val count = tail - head
+    val isFull = count === entries.U
+    val valid = VecInit(Seq.tabulate(entries)(i => age(i) < count))
+
+    io.head := head
+    io.tail := tail
+    io.count := count
+    io.addrValid := VecInit(buffer.map(_.addrValid))
+
+    // --- Broadcast Logic ---
+    // The broadcast that wakes the data operand also carries its value
+    when(io.broadcast.valid) {
+        val resPdst = io.broadcast.bits.pdst
+        for (i <- 0 until entries) {
+            val e = buffer(i)
+            when(e.bits.src1 === resPdst) {
+                e.bits.src1Ready := true.B
+            }
+            when(e.bits.src2 === resPdst) {
+                e.bits.src2Ready := true.B
+                val wakesData = valid(i) && !e.bits.src2Ready &&
+                    io.broadcast.bits.writeEn
+                when(wakesData) {
+                    e.data := io.broadcast.bits.data
+                    e.dataValid := true.B
+                }
+            }
+        }
+    }
+
+    // --- Commit Tracking ---
+    for (i <- 0 until entries) {
+        when(valid(i) && buffer(i).bits.robTag === io.robHead) {
+            buffer(i).committed := true.B
+        }
+    }
+
+    // --- Enqueue Logic ---
+    io.in.ready := !isFull && !io.flush.valid
+
+    when(io.in.fire) {
+        val entry = io.in.bits
+        val updatedEntry = Wire(new SequentialBufferEntry(new LoadStoreInfo))
+        updatedEntry := entry
+        when(io.broadcast.valid && entry.src1 === io.broadcast.bits.pdst) {
+            updatedEntry.src1Ready := true.B
+        }
+        when(io.broadcast.valid && entry.src2 === io.broadcast.bits.pdst) {
+            updatedEntry.src2Ready := true.B
+        }
+
+        printf(p"STQ: Enq robTag=${entry.robTag} tail=${tail}\n")
+
+        val e = buffer(slot(tail))
+        e.bits := updatedEntry
+        e.addrValid := false.B
+        e.dataValid := false.B
+        e.committed := false.B
+        tail := tail + 1.U
+    }
+
+    // --- Issue Logic (In Order) ---
+    // Only the address operand is needed
+    val issueEntry = buffer(slot(issuePtr))
+    io.issue.valid := issuePtr =/= tail && issueEntry.bits.src1Ready &&
+        !io.flush.valid
+    io.issue.bits.bits := issueEntry.bits
+    io.issue.bits.ldqIdx := 0.U
+    io.issue.bits.stqPtr := issuePtr
+    when(io.issue.fire) { issuePtr := issuePtr + 1.U }
+
+    when(io.resolve.valid) {
+        val e = buffer(slot(io.resolve.bits.ptr))
+        e.addr := io.resolve.bits.addr
+        e.addrValid := true.B
+        when(io.resolve.bits.dataValid) {
+            e.data := io.resolve.bits.data
+            e.dataValid := true.B
+        }
+    }
+
+    // --- Drain Logic ---
+    val headEntry = buffer(slot(head))
+    io.drain.valid := count =/= 0.U && headEntry.committed &&
+        headEntry.addrValid && headEntry.dataValid
+    io.drain.bits := headEntry
+    when(io.drain.fire) { head := head + 1.U }
+
+    // --- Forwarding ---
+    // Walk the older stores from oldest to youngest, so the youngest store
+    // writing a lane supplies it
+    val olderCount = io.fwd.stqPtr - head
+    val fwdValid = Wire(Vec(entries + 1, Vec(4, Bool())))
+    val fwdBytes = Wire(Vec(entries + 1, Vec(4, UInt(8.W))))
+    val fwdPending = Wire(Vec(entries + 1, Vec(4, Bool())))
+    fwdValid(0) := VecInit(Seq.fill(4)(false.B))
+    fwdBytes(0) := DontCare
+    fwdPending(0) := VecInit(Seq.fill(4)(false.B))
+    for (a <- 0 until entries) {
+        val e = buffer(slot(head + a.U))
+        val hit = a.U < olderCount && e.addr(31, 2) === io.fwd.addr(31, 2)
+        val mask = StoreQueue.laneMask(e.bits.info, e.addr)
+        for (b <- 0 until 4) {
+            val write = hit && mask(b)
+            fwdValid(a + 1)(b) := fwdValid(a)(b) || write
+            fwdBytes(a + 1)(b) :=
+                Mux(write, e.data(8 * b + 7, 8 * b), fwdBytes(a)(b))
+            fwdPending(a + 1)(b) := Mux(write, !e.dataValid, fwdPending(a)(b))
+        }
+    }
+    io.fwd.mask := fwdValid(entries).asUInt
+    io.fwd.data := fwdBytes(entries).asUInt
+    io.fwd.pending := fwdPending(entries).asUInt
+    io.fwd.older := olderCount =/= 0.U
+
+    // --- Flush Logic ---
+    // Uncommitted stores are the youngest entries, so the killed ones form a
+    // suffix from the head
+    when(io.flush.valid) {
+        val killed = VecInit(Seq.tabulate(entries) { a =>
+            val e = buffer(slot(head + a.U))
+            a.U < count && io.flush.checkKilled(e.bits.robTag) &&
+            !e.committed && io.robHead =/= e.bits.robTag
+        })
+        when(killed.asUInt.orR) {
+            val keep = PriorityEncoder(killed)
+            tail := head + keep
+            when(issuePtr - head > keep) { issuePtr := head + keep }
+        }
+    }
+}
+
+class LoadQueueEntry(stqEntries: Int) extends Bundle {
+    val bits = new SequentialBufferEntry(new LoadStoreInfo)
+    val stqPtr = UInt((log2Ceil(stqEntries) + 1).W)
+    val issued = Bool()
+}
+
+/** Load Queue
+  *
+  * Holds every load from dispatch until it leaves the LSU pipeline. A load
+  * issues once its base register is ready and every older store in the store
+  * queue knows its address, in any order with respect to other loads. A load
+  * the pipeline cannot finish is sent back with `replay` and issues again.
+  *
+  * @param entries
+  *   Number of entries
+  * @param stqEntries
+  *   Number of entries in the store queue
+  */
+class LoadQueue(entries: Int, stqEntries: Int) extends CycleAwareModule {
+    val stqIdxWidth = log2Ceil(stqEntries)
+    val stqPtrWidth = stqIdxWidth + 1
+
+    val io = IO(new Bundle {
+        val in = Flipped(Decoupled(new SequentialBufferEntry(new LoadStoreInfo)))
+        val broadcast = Input(Valid(new BroadcastBundle()))
+        val flush = Input(new FlushBundle)
+
+        // Store queue state
+        val stqHead = Input(UInt(stqPtrWidth.W))
+        val stqTail = Input(UInt(stqPtrWidth.W))
+        val stqAddrValid = Input(Vec(stqEntries, Bool()))
+
+        val out = Decoupled(new LSUIssueBundle(entries, stqEntries))
+        val replay = Flipped(Valid(UInt(log2Ceil(entries).W)))
+        val done = Flipped(Valid(UInt(log2Ceil(entries).W)))
+
+        val count = Output(UInt(log2Ceil(entries + 1).W))
+    })
+
+    val buffer = Reg(Vec(entries, new LoadQueueEntry(stqEntries)))
+    val valid = RegInit(VecInit(Seq.fill(entries)(false.B)))
+    val lastIssuedIndex = RegInit((entries - 1).U(log2Ceil(entries).W))
+    io.count := PopCount(valid)
+
+    when(io.flush.valid) {
+        for (i <- 0 until entries) {
+            when(valid(i) && io.flush.checkKilled(buffer(i).bits.robTag)) {
+                valid(i) := false.B
+            }
+        }
+    }
+
+    // Update readiness on Broadcast
+    when(io.broadcast.valid) {
+        for (i <- 0 until entries) {
+            when(buffer(i).bits.src1 === io.broadcast.bits.pdst) {
+                buffer(i).bits.src1Ready := true.B
+            }
+        }
+    }
+
+    // Enqueue Logic
+    io.in.ready := !valid.asUInt.andR && !io.flush.valid
+
+    val emptyIndex = PriorityEncoder(valid.map(!_))
+    when(io.in.fire) {
+        val entry = io.in.bits
+        val e = buffer(emptyIndex)
+        e.bits := entry
+        when(io.broadcast.valid && entry.src1 === io.broadcast.bits.pdst) {
+            e.bits.src1Ready := true.B
+        }
+        e.stqPtr := io.stqTail
+        e.issued := false.B
+        valid(emptyIndex) := true.B
+
+        printf(
+          p"LDQ: Enq robTag=${entry.robTag} pdst=${entry.pdst} idx=${emptyIndex}\n"
+        )
+    }
+
+    // Issue Logic (Round-Robin, as in IssueBuffer)
+    val stqHeadSlot = io.stqHead(stqIdxWidth - 1, 0)
+    def olderStoresKnown(e: LoadQueueEntry): Bool = {
+        val olderCount = e.stqPtr - io.stqHead
+        val known = Seq.tabulate(stqEntries) { j =>
+            val age = (j.U(stqIdxWidth.W) - stqHeadSlot)(stqIdxWidth - 1, 0)
+            io.stqAddrValid(j) || age >= olderCount
+        }
+        known.reduce(_ && _)
+    }
+    val readyEntries = VecInit(Seq.tabulate(entries) { i =>
+        valid(i) && !buffer(i).issued && buffer(i).bits.src1Ready &&
+        olderStoresKnown(buffer(i))
+    })
+    val maskedReadyEntries = VecInit(Seq.tabulate(entries) { i =>
+        readyEntries(i) && (i.U > lastIssuedIndex)
+    })
+    val issueIndex = Mux(
+      maskedReadyEntries.asUInt.orR,
+      PriorityEncoder(maskedReadyEntries),
+      PriorityEncoder(readyEntries)
+    )
+
+    io.out.valid := readyEntries.asUInt.orR && !io.flush.valid
+    io.out.bits.bits := buffer(issueIndex).bits
+    io.out.bits.ldqIdx := issueIndex
+    io.out.bits.stqPtr := buffer(issueIndex).stqPtr
+
+    when(io.out.fire) {
+        buffer(issueIndex).issued := true.B
+        lastIssuedIndex := issueIndex
+    }
+    when(io.replay.valid) { buffer(io.replay.bits).issued := false.B }
+    when(io.done.valid) { valid(io.done.bits) := false.B }
+}
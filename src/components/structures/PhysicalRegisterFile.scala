@@ -51,6 +51,17 @@ class PhysicalRegisterFile(
         val clrBusy = Vec(2, Flipped(Valid(UInt(log2Ceil(numRegs).W))))
         val isReady = Vec(numReadPorts, Output(Bool()))
         val readyAddrs = Vec(numReadPorts, Input(UInt(log2Ceil(numRegs).W)))
+
+        // Checkpoint support: initial values of p0-p31 (the reset mapping of
+        // x0-x31) and a view of every register
+        val boot =
+            if (Simulation.checkpointing)
+                Some(Flipped(Valid(Vec(32, UInt(dataWidth.W)))))
+            else None
+        val snapshot =
+            if (Simulation.checkpointing)
+                Some(Output(Vec(numRegs, UInt(dataWidth.W))))
+            else None
     })
 
     // Register array for data
@@ -73,6 +84,16 @@ class PhysicalRegisterFile(
         }
     }
 
+    // Boot values are written once, before any instruction is dispatched
+    io.boot.foreach { boot =>
+        when(boot.valid) {
+            for (i <- 1 until 32) {
+                regFile(i) := boot.bits(i)
+            }
+        }
+    }
+    io.snapshot.foreach(_ := regFile)
+
     // Busy Table Updates
     // Assertion first - setBusy and setReady should never target same register in same cycle
     when(
@@ -33,6 +33,12 @@ class RegisterAliasTable(
             if (Configurables.Elaboration.printRegFileOnCommit)
                 Some(Input(Bool()))
             else None
+
+        // Current mapping, used to read the architectural state for checkpoints
+        val archMap =
+            if (Configurables.Simulation.checkpointing)
+                Some(Output(Vec(32, UInt(PREG_WIDTH.W))))
+            else None
     })
 
     val rollback = IO(
@@ -68,6 +74,8 @@ class RegisterAliasTable(
         }
     }
 
+    io.archMap.foreach(_ := mapTable)
+
     if (Configurables.Elaboration.printRegFileOnCommit) {
         when(io.debugBroadcastValid.get) {
             printf("RAT Snapshot: Logical -> Physical:\n")
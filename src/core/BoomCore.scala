@@ -18,13 +18,36 @@ import common.Configurables._
   *
   * @param hexFile
   *   Path to the 32-bit hex file to load into DRAM.
+  * @param dramTiming
+  *   Default timing parameters of the simulated DRAM.
+  * @param dcacheConf
+  *   Data cache geometry and replacement policy.
+  * @param icacheConf
+  *   Instruction cache geometry and replacement policy.
+  * @param l2Conf
+  *   Unified L2 geometry, or None (the default) to connect the L1s straight
+  *   to DRAM. The L2 is blocking, see docs/memory.md.
+  * @param memPolicy
+  *   Arbitration between the L1s for the memory side.
+  * @param btbConf
+  *   Branch target buffer geometry.
   */
-class BoomCore(val hexFile: String) extends CycleAwareModule {
+class BoomCore(
+    val hexFile: String,
+    val dramTiming: DRAMTiming = DRAMTiming(),
+    val dcacheConf: CacheConfig = MemorySubsystem.defaultCache,
+    val icacheConf: CacheConfig = ICache.defaultCache,
+    val l2Conf: Option[CacheConfig] = None,
+    val memPolicy: ArbiterPolicy = ArbiterPolicy.ReadsFirst,
+    val btbConf: BTBConfig = BranchTargetBuffer.defaultConf
+) extends CycleAwareModule {
     // IO Definition
     val io = IO(new Bundle {
         val exit = Output(Valid(UInt(32.W)))
         val put = Decoupled(UInt(32.W))
-        val profiler = Output(new BoomCoreProfileBundle)
+        val profiler = Output(new BoomCoreProfileBundle(dcacheConf.nWays))
+        val checkpoint =
+            if (Simulation.checkpointing) Some(new CheckpointControl) else None
     })
 
     // Component Instantiation
@@ -36,10 +59,9 @@ class BoomCore(val hexFile: String) extends CycleAwareModule {
     val dispatchRouter = Module(new DispatchRouter)
     val rat = Module(new RegisterAliasTable(3, 1, 2))
     val freeList = Module(new FreeList(Derived.PREG_COUNT, 32))
-    val icache = Module(
-      new ICache(CacheConfig(nSetsWidth = 6, nCacheLineWidth = 4, idOffset = 2))
-    )
-    val btb = Module(new BranchTargetBuffer)
+    val icache = Module(new ICache(icacheConf))
+    val btb = Module(new BranchTargetBuffer(btbConf))
+    val dirPredictor = Module(new GsharePredictor)
 
     val rob = Module(new ReOrderBuffer)
     val aluIB = Module(new IssueBuffer(new ALUInfo, 16, "ALU_IB"))
@@ -60,36 +82,40 @@ class BoomCore(val hexFile: String) extends CycleAwareModule {
     val mmio = Module(
       new MMIORouter(Seq(MMIOAddress.PUT_ADDR.U, MMIOAddress.EXIT_ADDR.U))
     )
-    val memory = Module(new MemorySubsystem)
+    val memory = Module(new MemorySubsystem(dcacheConf))
     val lsAdaptor = Module(new LoadStoreAdaptor)
 
     // Unified Memory System Integration
     val memConf = MemConfig(idWidth = 4, addrWidth = 32, dataWidth = 128)
-    val dram = Module(new DPIDRAM(memConf, hexFile))
+    val dram = Module(new DPIDRAM(memConf, hexFile, dramTiming))
     dram.io.clock := clock
     dram.io.reset := reset.asBool
-
-    // Arbiter for DRAM Requests (2 Masters: D-Cache (0), I-Cache (1))
-    val dramArb = Module(new RRArbiter(new MemRequest(memConf), 2))
-
-    // Connect D-Cache (memory) to Arbiter Port 0
-    dramArb.io.in(0) <> memory.io.dram.req
-
-    // Connect I-Cache (imem) to Arbiter Port 1
-    dramArb.io.in(1) <> icache.io.dram.req
-
-    // Connect Arbiter to DRAM
-    dram.io.req <> dramArb.io.out
-
-    // Broadcast DRAM Response to both
-    // They will filter based on ID (D-Cache: 0,1; I-Cache: 2,3)
-    memory.io.dram.resp.valid := dram.io.resp.valid
-    memory.io.dram.resp.bits := dram.io.resp.bits
-    icache.io.dram.resp.valid := dram.io.resp.valid
-    icache.io.dram.resp.bits := dram.io.resp.bits
-
-    // Backpressure: DRAM ready if both listeners are ready
-    dram.io.resp.ready := memory.io.dram.resp.ready && icache.io.dram.resp.ready
+    dram.io.ckpt.valid := false.B
+    dram.io.ckpt.bits := DontCare
+
+    // Interconnect for the L1s (Masters: I-Cache (0), D-Cache (1)). Each
+    // master gets its own ID range and response queue.
+    val l1Masters = Seq(icache.io.dram, memory.io.dram)
+    val memBus = Module(
+      new MemInterconnect(
+        memConf,
+        Seq(icache.nDramIds, memory.nDramIds),
+        memPolicy
+      )
+    )
+    memBus.io.masters.zip(l1Masters).foreach { case (port, m) => port <> m }
+
+    // Connect the interconnect to the L2, or straight to DRAM without one
+    val l2 = l2Conf.map(c => Module(new L2Cache(c, memConf)))
+    l2 match {
+        case Some(l2) =>
+            l2.io.upstream <> memBus.io.mem
+            dram.io.req <> l2.io.dram.req
+            l2.io.dram.resp <> dram.io.resp
+        case None =>
+            dram.io.req <> memBus.io.mem.req
+            memBus.io.mem.resp <> dram.io.resp
+    }
 
     // Generic memory routing: Adaptor -> MemorySubsystem -> (LSU | MMIO)
     memory.io.upstream <> lsAdaptor.io.mem
@@ -107,21 +133,32 @@ class BoomCore(val hexFile: String) extends CycleAwareModule {
     // BTB integration
     btb.io.pc := fetcher.io.instAddr
     fetcher.io.btbResult := btb.io.target
+    fetcher.io.btbIsCond := btb.io.isCond
+
+    // Direction predictor, indexed with the fetcher's global history
+    dirPredictor.io.pc := fetcher.io.instAddr
+    dirPredictor.io.ghist := fetcher.io.ghist
+    fetcher.io.dirCounters := dirPredictor.io.counters
 
     // Memory interface for fetcher
     icache.io.req <> fetcher.io.icache.req
     fetcher.io.icache.resp <> icache.io.resp
 
-    // Frontend queue (in-stage buffer between fetcher and decoder)
+    // Frontend queue (in-stage buffer of fetch packets between fetcher and
+    // decoder). The splitter feeds its head packet to the decoder one
+    // instruction at a time.
     val fetcherDecoderQueue = Module(
       new Queue(
-        new FetchToDecodeBundle,
+        new FetchPacket,
         entries = 2,
         pipe = false,
         flow = false
       )
     )
     fetcherDecoderQueue.io.enq <> fetcher.io.ifOut
+    val packetSplitter = Module(new PacketSplitter)
+    packetSplitter.io.in <> fetcherDecoderQueue.io.deq
+    val fetchOut = packetSplitter.io.out
 
     // RAS Adaptor connections
     val rasPredictedValid = RegNext(rasAdaptor.io.out.fire, init = false.B)
@@ -134,11 +171,11 @@ class BoomCore(val hexFile: String) extends CycleAwareModule {
     // Wire up Decoder & RASAdaptor to output of ifQueue
     // -- decoder.io.in <> ifQueue.io.deq
     // -- rasAdaptor.io.in <> ifQueue.io.deq
-    fetcherDecoderQueue.io.deq.ready := decoder.io.in.ready && rasAdaptor.io.in.ready
-    decoder.io.in.valid := fetcherDecoderQueue.io.deq.valid && !rasFlush
-    decoder.io.in.bits := fetcherDecoderQueue.io.deq.bits
-    rasAdaptor.io.in.valid := fetcherDecoderQueue.io.deq.valid && !rasFlush
-    rasAdaptor.io.in.bits := fetcherDecoderQueue.io.deq.bits
+    fetchOut.ready := decoder.io.in.ready && rasAdaptor.io.in.ready
+    decoder.io.in.valid := fetchOut.valid && !rasFlush
+    decoder.io.in.bits := fetchOut.bits
+    rasAdaptor.io.in.valid := fetchOut.valid && !rasFlush
+    rasAdaptor.io.in.bits := fetchOut.bits
 
     // Wire output of Decoder & RASAdaptor to Plexer
     decodeRASPlexer.io.instFromDecoder <> decoder.io.out
@@ -154,6 +191,13 @@ class BoomCore(val hexFile: String) extends CycleAwareModule {
     plexerDispatcherQueue.io.enq <> decodeRASPlexer.io.plexToDispatcher
     dispatcher.io.instInput <> plexerDispatcherQueue.io.deq
 
+    // Dispatch is held while draining the pipeline for a checkpoint
+    val ckptDrain = WireInit(false.B)
+    when(ckptDrain) {
+        dispatcher.io.instInput.valid := false.B
+        plexerDispatcherQueue.io.deq.ready := false.B
+    }
+
     // On RAS predict overwrite, set pc_overwrite for IF and reset ifQueue
 
     // RAS Recovery
@@ -164,6 +208,7 @@ class BoomCore(val hexFile: String) extends CycleAwareModule {
         bruAdaptor.io.brUpdate.valid && bruAdaptor.io.brUpdate.mispredict
     plexerDispatcherQueue.reset := reset.asBool || backendMispredict
     fetcherDecoderQueue.reset := reset.asBool || fetcher.io.pcOverwrite.valid
+    packetSplitter.reset := fetcherDecoderQueue.reset
     when(fetcherDecoderQueue.reset.asBool) {
         printf(p"IF Queue Reset\n")
     }
@@ -280,15 +325,37 @@ class BoomCore(val hexFile: String) extends CycleAwareModule {
     btb.io.update.bits.pc := brUpdate.pc
     btb.io.update.bits.target := brUpdate.target
     btb.io.update.bits.taken := brUpdate.taken
+    btb.io.update.bits.isCond := brUpdate.isCond
     btb.io.update.bits.mispredict := brUpdate.mispredict
+    // Direct jumps are installed as soon as they are decoded
+    btb.io.fill := rasAdaptor.io.btbFill
+
+    // Direction Predictor Update: conditional branches train their counter,
+    // and a redirect rebuilds the history from the redirecting packet: a
+    // misprediction with the branch's outcome, a RAS redirect as taken
+    dirPredictor.io.update.valid := brUpdate.valid && brUpdate.isCond
+    dirPredictor.io.update.bits.pc := brUpdate.pc
+    dirPredictor.io.update.bits.meta := brUpdate.bpMeta
+    dirPredictor.io.update.bits.taken := brUpdate.taken
+    fetcher.io.histRepair.valid := mispredict || rasFlush
+    fetcher.io.histRepair.bits := Mux(
+      mispredict,
+      Cat(brUpdate.bpMeta.ghist, brUpdate.taken),
+      Cat(rasPredictedSignal.ghist, 1.U(1.W))
+    )(GHIST_WIDTH - 1, 0)
 
     rob.io.brUpdate.valid := mispredict
     rob.io.brUpdate.bits.robTag := brUpdate.robTag
     rob.io.brUpdate.bits.mispredict := mispredict
 
     // # Misprediction
-    // Fetcher PC Overwrite (Misprediction or RAS Re-predict)
-    when(mispredict) {
+    // Fetcher PC Overwrite (Boot, Misprediction or RAS Re-predict)
+    // The first cycle out of reset redirects to the DRAM model's boot PC
+    val bootCycle = RegNext(reset.asBool, init = true.B) && !reset.asBool
+    when(bootCycle) {
+        fetcher.io.pcOverwrite.valid := true.B
+        fetcher.io.pcOverwrite.bits := dram.io.boot.pc
+    }.elsewhen(mispredict) {
         fetcher.io.pcOverwrite.valid := true.B
         fetcher.io.pcOverwrite.bits := Mux(
           brUpdate.taken,
@@ -351,6 +418,62 @@ class BoomCore(val hexFile: String) extends CycleAwareModule {
         prf.io.clrBusy(i).bits := rollback(i).bits.pdst
     }
 
+    // # Checkpointing
+    // Restore: the DRAM model supplies the register values to boot with.
+    // Capture: stop dispatch, wait until the ROB and LSU are empty, write
+    // back the D-cache and then the L2, then hand the committed state to the
+    // DRAM model.
+    // With the ROB empty, the RAT holds the committed mapping and the
+    // instruction waiting at the dispatcher is the next PC.
+    prf.io.boot.foreach { boot =>
+        boot.valid := bootCycle
+        boot.bits := dram.io.boot.regs.asTypeOf(Vec(32, UInt(32.W)))
+    }
+    memory.io.flush.req := false.B
+    l2.foreach(_.io.flush.req := false.B)
+
+    io.checkpoint.foreach { ckpt =>
+        val sRun :: sDrain :: sFlush :: sDone :: Nil = Enum(4)
+        val ckptState = RegInit(sRun)
+        val cycles = RegInit(0.U(64.W))
+        val insts = RegInit(0.U(64.W))
+        cycles := cycles + 1.U
+        when(rob.io.commit.fire) { insts := insts + 1.U }
+
+        val trigger =
+            (ckpt.atCycle =/= 0.U && cycles >= ckpt.atCycle) ||
+                (ckpt.atInst =/= 0.U && insts >= ckpt.atInst)
+        val quiescent = rob.io.empty.get && lsAdaptor.io.idle.get &&
+            plexerDispatcherQueue.io.deq.valid && !mispredict
+
+        ckptDrain := ckptState === sDrain || ckptState === sFlush
+        memory.io.flush.req := ckptState === sFlush
+        // The L2 is flushed once the D-cache has written its lines into it
+        val l2Flushed = l2
+            .map { l2 =>
+                l2.io.flush.req := ckptState === sFlush && memory.io.flush.done
+                l2.io.flush.done
+            }
+            .getOrElse(true.B)
+
+        when(ckptState === sRun && trigger) { ckptState := sDrain }
+        when(ckptState === sDrain && quiescent) { ckptState := sFlush }
+        when(ckptState === sFlush && memory.io.flush.done && l2Flushed) {
+            ckptState := sDone
+            dram.io.ckpt.valid := true.B
+            printf(
+              p"Checkpoint at PC 0x${Hexadecimal(plexerDispatcherQueue.io.deq.bits.inst.pc)}\n"
+            )
+        }
+
+        val archRegs = VecInit(
+          rat.io.archMap.get.map(preg => prf.io.snapshot.get(preg))
+        )
+        dram.io.ckpt.bits.pc := plexerDispatcherQueue.io.deq.bits.inst.pc
+        dram.io.ckpt.bits.regs := archRegs.asUInt
+        ckpt.done := ckptState === sDone
+    }
+
     // # Debug & Profiling
     if (Configurables.Profiling.branchMispredictionRate) {
         val totalBranches = WireInit(0.U(32.W))
@@ -464,7 +587,9 @@ class BoomCore(val hexFile: String) extends CycleAwareModule {
         val waitDepMultSum = RegInit(0.U(64.W))
 
         // Counter Updates
-        when(fetcher.io.ifOut.fire) { countFetcherSum := countFetcherSum + 1.U }
+        when(fetcher.io.ifOut.fire) {
+            countFetcherSum := countFetcherSum + PopCount(fetcher.io.ifOut.bits.mask)
+        }
         when(decoder.io.out.fire) { countDecoderSum := countDecoderSum + 1.U }
         when(dispatcher.io.instOutput.fire) {
             countDispatcherSum := countDispatcherSum + 1.U
@@ -622,28 +747,87 @@ class BoomCore(val hexFile: String) extends CycleAwareModule {
     if (Configurables.Profiling.CacheStats) {
         val dcacheHits = RegInit(0.U(64.W))
         val dcacheMisses = RegInit(0.U(64.W))
+        val dcacheWayHits =
+            RegInit(VecInit(Seq.fill(dcacheConf.nWays)(0.U(64.W))))
+        val dcacheWayRefills =
+            RegInit(VecInit(Seq.fill(dcacheConf.nWays)(0.U(64.W))))
+        val dcachePrefetches = RegInit(0.U(64.W))
+        val dcachePrefetchHits = RegInit(0.U(64.W))
         val icacheHits = RegInit(0.U(64.W))
         val icacheMisses = RegInit(0.U(64.W))
+        val icachePrefetches = RegInit(0.U(64.W))
+        val icacheStreamHits = RegInit(0.U(64.W))
+        val icacheWayMispredicts = RegInit(0.U(64.W))
+        val l2Hits = RegInit(0.U(64.W))
+        val l2Misses = RegInit(0.U(64.W))
+        val l2Evictions = RegInit(0.U(64.W))
         val dramAccesses = RegInit(0.U(64.W))
 
         when(memory.io.cacheEvents.hit) { dcacheHits := dcacheHits + 1.U }
         when(memory.io.cacheEvents.miss) { dcacheMisses := dcacheMisses + 1.U }
+        val dcacheWay = memory.io.cacheEvents.way
+        when(memory.io.cacheEvents.hit) {
+            dcacheWayHits(dcacheWay) := dcacheWayHits(dcacheWay) + 1.U
+        }
+        when(memory.io.cacheEvents.miss) {
+            dcacheWayRefills(dcacheWay) := dcacheWayRefills(dcacheWay) + 1.U
+        }
+        when(memory.io.cacheEvents.prefetchIssued) {
+            dcachePrefetches := dcachePrefetches + 1.U
+        }
+        when(memory.io.cacheEvents.prefetchUseful) {
+            dcachePrefetchHits := dcachePrefetchHits + 1.U
+        }
         when(icache.io.events.hit) { icacheHits := icacheHits + 1.U }
         when(icache.io.events.miss) { icacheMisses := icacheMisses + 1.U }
-        when(dramArb.io.out.valid && dramArb.io.out.ready) {
+        when(icache.io.events.prefetchIssued) {
+            icachePrefetches := icachePrefetches + 1.U
+        }
+        when(icache.io.events.prefetchUseful) {
+            icacheStreamHits := icacheStreamHits + 1.U
+        }
+        when(icache.io.events.wayMispredict) {
+            icacheWayMispredicts := icacheWayMispredicts + 1.U
+        }
+        l2.foreach { l2 =>
+            when(l2.io.events.hit) { l2Hits := l2Hits + 1.U }
+            when(l2.io.events.miss) { l2Misses := l2Misses + 1.U }
+            when(l2.io.events.eviction) { l2Evictions := l2Evictions + 1.U }
+        }
+        when(dram.io.req.valid && dram.io.req.ready) {
             dramAccesses := dramAccesses + 1.U
         }
 
         io.profiler.dcacheHits.get := dcacheHits
         io.profiler.dcacheMisses.get := dcacheMisses
+        io.profiler.dcacheWayHits.get := dcacheWayHits
+        io.profiler.dcacheWayRefills.get := dcacheWayRefills
+        io.profiler.dcachePrefetches.get := dcachePrefetches
+        io.profiler.dcachePrefetchHits.get := dcachePrefetchHits
         io.profiler.icacheHits.get := icacheHits
         io.profiler.icacheMisses.get := icacheMisses
+        io.profiler.icachePrefetches.get := icachePrefetches
+        io.profiler.icacheStreamHits.get := icacheStreamHits
+        io.profiler.icacheWayMispredicts.get := icacheWayMispredicts
+        io.profiler.l2Hits.get := l2Hits
+        io.profiler.l2Misses.get := l2Misses
+        io.profiler.l2Evictions.get := l2Evictions
         io.profiler.dramAccesses.get := dramAccesses
 
         dontTouch(dcacheHits)
         dontTouch(dcacheMisses)
+        dontTouch(dcacheWayHits)
+        dontTouch(dcacheWayRefills)
+        dontTouch(dcachePrefetches)
+        dontTouch(dcachePrefetchHits)
         dontTouch(icacheHits)
         dontTouch(icacheMisses)
+        dontTouch(icachePrefetches)
+        dontTouch(icacheStreamHits)
+        dontTouch(icacheWayMispredicts)
+        dontTouch(l2Hits)
+        dontTouch(l2Misses)
+        dontTouch(l2Evictions)
         dontTouch(dramAccesses)
     }
 }
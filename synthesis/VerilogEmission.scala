@@ -51,6 +51,7 @@ object VerilogEmission {
         // Prune optional profiling and elaboration wiring for synthesis
         Profiling.prune()
         Elaboration.prune()
+        Simulation.prune()
         ChiselStage.emitSystemVerilogFile(
           new BoomCore(hexFile),
           args = genArgs,
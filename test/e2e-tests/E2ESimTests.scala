@@ -33,10 +33,10 @@ class E2ESimTests extends AnyFunSuite {
             val name = cFile.getFileName.toString.stripSuffix(".c")
             test(s"Sim test: $name") {
                 val expected = readExpected(cFile)
-                val hex = buildHexFor(cFile)
+                val elf = buildElfFor(cFile)
 
                 val maxCycles = MAX_CYCLE_COUNT
-                val simRes = runTestWithHex(hex, maxCycles)
+                val simRes = runTestWithImage(elf, maxCycles)
 
                 assert(
                   !simRes.timedOut,
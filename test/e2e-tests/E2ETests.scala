@@ -31,9 +31,9 @@ class E2ETests extends AnyFunSuite {
             val name = cFile.getFileName.toString.stripSuffix(".c")
             test(s"C test: $name") {
                 val expected = readExpected(cFile)
-                val sourceHex = buildHexFor(cFile)
+                val elf = buildElfFor(cFile)
 
-                val simRes = runTestWithHex(sourceHex)
+                val simRes = runTestWithImage(elf)
 
                 assert(
                   !simRes.timedOut,
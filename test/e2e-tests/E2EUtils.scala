@@ -7,6 +7,9 @@ import scala.sys.process.Process
 import chisel3._
 import chisel3.simulator.EphemeralSimulator._
 import core.BoomCore
+import components.frontend.{BTBConfig, BranchTargetBuffer}
+import components.memory.{ArbiterPolicy, CacheConfig, ICache}
+import components.structures.MemorySubsystem
 
 object E2EUtils {
     // Flag to detect if running in CI environment
@@ -29,7 +32,9 @@ object E2EUtils {
         repoRoot.resolve("test/e2e-tests/resources/expected")
     val linkageDir: Path = repoRoot.resolve("test/e2e-tests/resources/linkage")
     val genDir: Path = repoRoot.resolve("test/e2e-tests/generated")
-    val sharedHexPath: Path = genDir.resolve("shared_program.hex")
+    // Shared image paths, one per format, so BoomCore is not recompiled
+    def sharedImagePath(ext: String): Path =
+        genDir.resolve(s"shared_program.$ext")
     val simtestsDir: Path = cDir.resolve("simtests")
     val skipJson: Path = repoRoot.resolve("test/e2e-tests/resources/skip.jsonc")
 
@@ -121,13 +126,13 @@ object E2EUtils {
         Files.write(hexPath, lines.toString.getBytes(StandardCharsets.UTF_8))
     }
 
-    def buildHexFor(cFile: Path): Path = {
+    /** Compiles a C test into an ELF image that DPIDRAM can load directly.
+      */
+    def buildElfFor(cFile: Path): Path = {
         Files.createDirectories(genDir)
         val name = cFile.getFileName.toString.stripSuffix(".c")
 
         val elf = genDir.resolve(s"$name.elf")
-        val bin = genDir.resolve(s"$name.bin")
-        val hex = genDir.resolve(s"$name.hex")
 
         val linkLd = linkageDir.resolve("link.ld")
         val crt0 = linkageDir.resolve("crt0.S")
@@ -142,15 +147,15 @@ object E2EUtils {
         }
         val dependencies = Seq(cFile, linkLd, crt0, mathC) ++ headerFiles
 
-        // If hex exists and is newer than all dependencies, skip rebuild
-        if (Files.exists(hex)) {
-            val hexTime = Files.getLastModifiedTime(hex).toMillis
+        // If elf exists and is newer than all dependencies, skip rebuild
+        if (Files.exists(elf)) {
+            val elfTime = Files.getLastModifiedTime(elf).toMillis
             val upToDate = !dependencies.exists(d =>
                 Files.exists(d) && Files
                     .getLastModifiedTime(d)
-                    .toMillis > hexTime
+                    .toMillis > elfTime
             )
-            if (upToDate) return hex
+            if (upToDate) return elf
         }
 
         val compileCmd = Seq(
@@ -181,6 +186,23 @@ object E2EUtils {
           s"Compile failed for ${cFile.getFileName} (rc=$ccRc)"
         )
 
+        elf
+    }
+
+    /** Compiles a C test and converts it into a 32-bit word hex file.
+      */
+    def buildHexFor(cFile: Path): Path = {
+        val name = cFile.getFileName.toString.stripSuffix(".c")
+
+        val elf = buildElfFor(cFile)
+        val bin = genDir.resolve(s"$name.bin")
+        val hex = genDir.resolve(s"$name.hex")
+
+        if (
+          Files.exists(hex) && Files.getLastModifiedTime(hex).toMillis >=
+              Files.getLastModifiedTime(elf).toMillis
+        ) return hex
+
         val objRc = Process(
           Seq(
             objcopy,
@@ -213,6 +235,24 @@ object E2EUtils {
         timedOut: Boolean
     )
 
+    /** Checkpoint to take during a run, see `docs/dram.md`
+      *
+      * @param atCycle
+      *   Cycle to checkpoint at (0 disables)
+      * @param atInst
+      *   Committed instruction count to checkpoint at (0 disables)
+      * @param out
+      *   Where to store the checkpoint file
+      * @param stop
+      *   End the simulation once the checkpoint is written
+      */
+    case class CheckpointRequest(
+        atCycle: Long = 0,
+        atInst: Long = 0,
+        out: Path,
+        stop: Boolean = true
+    )
+
     def setupSimulation() {
         val requireReport = System.getProperty("report") == "true"
         // println(s"requireReport=$requireReport, isAnyEnabled=${common.Configurables.Profiling.isAnyEnabled}")
@@ -220,18 +260,66 @@ object E2EUtils {
             common.Configurables.Profiling.prune()
         }
     }
-    def runTestWithHex(
-        hexPath: Path,
-        maxCycles: Int = Configurables.MAX_CYCLE_COUNT
+    /** Runs a program image on BoomCore.
+      *
+      * @param imagePath
+      *   An ELF (`.elf`), raw binary loaded at 0 (`.bin`), checkpoint
+      *   (`.ckpt`) or hex file
+      * @param checkpoint
+      *   Optional checkpoint to take during the run
+      * @param dcache
+      *   Data cache configuration of the simulated core
+      * @param icache
+      *   Instruction cache configuration of the simulated core
+      * @param l2
+      *   L2 configuration of the simulated core, None for no L2
+      * @param memPolicy
+      *   Arbitration between the L1s of the simulated core
+      * @param btb
+      *   Branch target buffer configuration of the simulated core
+      */
+    def runTestWithImage(
+        imagePath: Path,
+        maxCycles: Int = Configurables.MAX_CYCLE_COUNT,
+        checkpoint: Option[CheckpointRequest] = None,
+        dcache: CacheConfig = MemorySubsystem.defaultCache,
+        icache: CacheConfig = ICache.defaultCache,
+        l2: Option[CacheConfig] = None,
+        memPolicy: ArbiterPolicy = ArbiterPolicy.ReadsFirst,
+        btb: BTBConfig = BranchTargetBuffer.defaultConf
     ): SimulationResult = {
         setupSimulation()
-        // Shared path for the hex file to avoid recompilation of BoomCore
+        // Shared path for the image file to avoid recompilation of BoomCore
         // We place it outside the specific test run directory so it persists/is accessible
-        Files.copy(hexPath, sharedHexPath, StandardCopyOption.REPLACE_EXISTING)
+        val fileName = imagePath.getFileName.toString
+        val ext = Seq("elf", "bin", "ckpt")
+            .find(e => fileName.endsWith(s".$e"))
+            .getOrElse("hex")
+        val sharedPath = sharedImagePath(ext)
+        Files.copy(imagePath, sharedPath, StandardCopyOption.REPLACE_EXISTING)
+
+        // The DRAM model writes checkpoints next to the image it loaded
+        val ckptPath =
+            sharedPath.resolveSibling(s"${sharedPath.getFileName}.ckpt")
+        Files.deleteIfExists(ckptPath)
 
         var res: SimulationResult = null
-        simulate(new BoomCore(sharedHexPath.toAbsolutePath.toString)) { dut =>
-            res = runSimulation(dut, maxCycles)
+        simulate(
+          new BoomCore(
+            sharedPath.toAbsolutePath.toString,
+            dcacheConf = dcache,
+            icacheConf = icache,
+            l2Conf = l2,
+            memPolicy = memPolicy,
+            btbConf = btb
+          )
+        ) { dut =>
+            res = runSimulation(dut, maxCycles, checkpoint = checkpoint)
+        }
+        checkpoint.foreach { c =>
+            if (Files.exists(ckptPath)) {
+                Files.move(ckptPath, c.out, StandardCopyOption.REPLACE_EXISTING)
+            }
         }
         res
     }
@@ -240,9 +328,19 @@ object E2EUtils {
         dut: BoomCore,
         maxCycles: Int = Configurables.MAX_CYCLE_COUNT,
         debugCallback: (Int) => Unit = _ => (),
-        report: Boolean = true
+        report: Boolean = true,
+        checkpoint: Option[CheckpointRequest] = None
     ): SimulationResult = {
 
+        dut.io.checkpoint.foreach { c =>
+            c.atCycle.poke(checkpoint.map(_.atCycle).getOrElse(0L).U)
+            c.atInst.poke(checkpoint.map(_.atInst).getOrElse(0L).U)
+        }
+        require(
+          checkpoint.isEmpty || dut.io.checkpoint.isDefined,
+          "Checkpointing is disabled in this build"
+        )
+
         dut.reset.poke(true.B)
         dut.clock.step()
         dut.reset.poke(false.B)
@@ -292,6 +390,14 @@ object E2EUtils {
                 done = true
             }
 
+            // Stop after a requested checkpoint has been written
+            if (
+              checkpoint.exists(_.stop) &&
+              dut.io.checkpoint.get.done.peek().litToBoolean
+            ) {
+                done = true
+            }
+
             // Drain debug output queue
             // We use a small loop to drain up to 'batchSize' elements or until empty
             var drained = 0
@@ -350,6 +456,61 @@ object E2EUtils {
                 println(f"  IPC:                  $ipc%.4f")
             }
 
+            if (common.Configurables.Profiling.CacheStats) {
+                def missRate(hits: BigInt, misses: BigInt): Double =
+                    if (hits + misses > 0)
+                        misses.toDouble / (hits + misses).toDouble * 100.0
+                    else 0.0
+                val dHits = p.dcacheHits.get.peek().litValue
+                val dMisses = p.dcacheMisses.get.peek().litValue
+                val iHits = p.icacheHits.get.peek().litValue
+                val iMisses = p.icacheMisses.get.peek().litValue
+                val dram = p.dramAccesses.get.peek().litValue
+
+                println(f"Cache Performance:")
+                println(
+                  f"  D-Cache: $dHits%8d hits, $dMisses%8d misses (${missRate(dHits, dMisses)}%.2f%% miss)"
+                )
+                val wayHits = p.dcacheWayHits.get.map(_.peek().litValue)
+                val wayRefills = p.dcacheWayRefills.get.map(_.peek().litValue)
+                if (wayHits.length > 1) {
+                    wayHits.zip(wayRefills).zipWithIndex.foreach {
+                        case ((h, r), w) =>
+                            println(f"    Way $w%-2d: $h%8d hits, $r%8d refills")
+                    }
+                }
+                // Accuracy: share of prefetches that were used. Coverage: share
+                // of would-be misses that a prefetch removed.
+                val pf = p.dcachePrefetches.get.peek().litValue
+                val pfHits = p.dcachePrefetchHits.get.peek().litValue
+                def pct(a: BigInt, b: BigInt): Double =
+                    if (b > 0) a.toDouble / b.toDouble * 100.0 else 0.0
+                println(
+                  f"  D-Prefetch: $pf%8d issued, $pfHits%8d used (accuracy ${pct(pfHits, pf)}%.2f%%, coverage ${pct(pfHits, pfHits + dMisses)}%.2f%%)"
+                )
+                println(
+                  f"  I-Cache: $iHits%8d hits, $iMisses%8d misses (${missRate(iHits, iMisses)}%.2f%% miss)"
+                )
+                val iPf = p.icachePrefetches.get.peek().litValue
+                val iStream = p.icacheStreamHits.get.peek().litValue
+                println(
+                  f"  I-Stream: $iPf%8d lines fetched, $iStream%8d used (accuracy ${pct(iStream, iPf)}%.2f%%)"
+                )
+                val iWayMiss = p.icacheWayMispredicts.get.peek().litValue
+                println(
+                  f"  I-Way Prediction: $iWayMiss%8d mispredicts (${pct(iWayMiss, iHits + iWayMiss)}%.2f%% of hits)"
+                )
+                val l2Hits = p.l2Hits.get.peek().litValue
+                val l2Misses = p.l2Misses.get.peek().litValue
+                val l2Evictions = p.l2Evictions.get.peek().litValue
+                if (l2Hits + l2Misses > 0) {
+                    println(
+                      f"  L2 Cache: $l2Hits%8d hits, $l2Misses%8d misses (${missRate(l2Hits, l2Misses)}%.2f%% miss), $l2Evictions%8d evictions"
+                    )
+                }
+                println(f"  DRAM Accesses:        $dram")
+            }
+
             if (common.Configurables.Profiling.RollbackTime) {
                 val events = p.totalRollbackEvents.get.peek().litValue
                 val cycles = p.totalRollbackCycles.get.peek().litValue
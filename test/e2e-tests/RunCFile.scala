@@ -3,16 +3,33 @@ package e2e
 import java.nio.file.{Path, Paths, Files}
 import common.Configurables._
 import e2e.Configurables._
+import components.frontend.BranchTargetBuffer
+import components.memory.{ArbiterPolicy, ICache, L2Cache, ReplacementPolicy}
+import components.structures.MemorySubsystem
 
 object RunCFile extends App {
     val argList = args.toList
     val verbose = argList.contains("-v") || argList.contains("--verbose")
     val positionalArgs = argList.filterNot(arg => arg.startsWith("-"))
+    def option(name: String): Option[String] =
+        argList.collectFirst {
+            case arg if arg.startsWith(s"--$name=") =>
+                arg.stripPrefix(s"--$name=")
+        }
 
     if (positionalArgs.isEmpty) {
         println("Usage: RunCFile [options] <path_to_c_file>")
         println("Options:")
         println("  -v, --verbose    Enable verbose debug output")
+        println("  --checkpoint-cycle=<n>  Checkpoint at cycle n and stop")
+        println("  --checkpoint-inst=<n>   Checkpoint after n committed instructions and stop")
+        println("  --checkpoint-out=<file> Checkpoint file (default: generated/<name>.ckpt)")
+        println("  --dcache-ways=<n>       D-cache associativity, capacity is kept (default: 1)")
+        println("  --dcache-policy=<name>  D-cache replacement: lru, plru, random (default: lru)")
+        println("  --icache-ways=<n>       I-cache associativity, 1 KiB per way (default: 4)")
+        println("  --l2                    Add the unified L2 between the L1s and DRAM")
+        println("  --mem-policy=<name>     L1 arbitration: rr, fixed, readsfirst (default: readsfirst)")
+        println("  --btb-ways=<n>          BTB ways per slot, 64 entries per way (default: 4)")
         sys.exit(1)
     }
 
@@ -36,19 +53,87 @@ object RunCFile extends App {
     }
 
     println(s"Compiling ${cFileCandidate}...")
-    val hex =
+    val elf =
         try {
-            buildHexFor(cFileCandidate)
+            buildElfFor(cFileCandidate)
         } catch {
             case e: Exception =>
                 println(s"Compilation failed: ${e.getMessage}")
                 sys.exit(1)
         }
 
-    println(s"Running simulation using hex file: $hex")
+    println(s"Running simulation using elf file: $elf")
     println("Simulation started.")
 
-    val simRes = runTestWithHex(hex)
+    val ckptCycle = option("checkpoint-cycle").map(_.toLong).getOrElse(0L)
+    val ckptInst = option("checkpoint-inst").map(_.toLong).getOrElse(0L)
+    val checkpoint =
+        if (ckptCycle > 0 || ckptInst > 0) {
+            val out = option("checkpoint-out")
+                .map(Paths.get(_).toAbsolutePath)
+                .getOrElse(
+                  genDir.resolve(
+                    cFileCandidate.getFileName.toString.stripSuffix(".c") + ".ckpt"
+                  )
+                )
+            Some(CheckpointRequest(ckptCycle, ckptInst, out))
+        } else None
+
+    // Ways are traded against sets so that the D-cache capacity stays fixed
+    val dcacheWays = option("dcache-ways").map(_.toInt).getOrElse(1)
+    require(
+      dcacheWays > 0 && (dcacheWays & (dcacheWays - 1)) == 0,
+      "--dcache-ways must be a power of two"
+    )
+    val baseCache = MemorySubsystem.defaultCache
+    val dcache = baseCache.copy(
+      nSetsWidth =
+          baseCache.nSetsWidth - Integer.numberOfTrailingZeros(dcacheWays),
+      nWays = dcacheWays,
+      replacement = option("dcache-policy")
+          .map(ReplacementPolicy.fromString)
+          .getOrElse(baseCache.replacement)
+    )
+
+    // I-cache ways are added on top of a fixed number of sets
+    val icache = option("icache-ways")
+        .map { w =>
+            val ways = w.toInt
+            require(
+              ways > 0 && (ways & (ways - 1)) == 0,
+              "--icache-ways must be a power of two"
+            )
+            ICache.defaultCache.copy(nWays = ways)
+        }
+        .getOrElse(ICache.defaultCache)
+
+    // BTB ways are added on top of a fixed number of sets
+    val btb = option("btb-ways")
+        .map { w =>
+            val ways = w.toInt
+            require(
+              ways > 0 && (ways & (ways - 1)) == 0,
+              "--btb-ways must be a power of two"
+            )
+            BranchTargetBuffer.defaultConf.copy(nWays = ways)
+        }
+        .getOrElse(BranchTargetBuffer.defaultConf)
+
+    val simRes = runTestWithImage(
+      elf,
+      checkpoint = checkpoint,
+      dcache = dcache,
+      icache = icache,
+      l2 = if (argList.contains("--l2")) Some(L2Cache.defaultCache) else None,
+      memPolicy = option("mem-policy")
+          .map(ArbiterPolicy.fromString)
+          .getOrElse(ArbiterPolicy.ReadsFirst),
+      btb = btb
+    )
+    checkpoint.foreach { c =>
+        if (Files.exists(c.out)) println(s"Checkpoint saved to: ${c.out}")
+        else println("Checkpoint was not taken before the program finished.")
+    }
 
     Thread.sleep(500) // Wait for final prints to flush
     if (!simRes.timedOut) {
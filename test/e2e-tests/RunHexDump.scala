@@ -13,6 +13,7 @@ object RunHexDump extends App {
 
     if (positionalArgs.isEmpty) {
         println("Usage: RunHexDump [options] <path_to_hex_file>")
+        println("       (.elf, .bin and .ckpt images are loaded as-is)")
         println("Options:")
         println("  -v, --verbose    Enable verbose debug output")
         sys.exit(1)
@@ -28,8 +29,10 @@ object RunHexDump extends App {
         sys.exit(1)
     }
 
+    val isBinaryImage =
+        Seq(".elf", ".bin", ".ckpt").exists(hexFile.toString.endsWith)
     val normalizedPath =
-        if (isByteAligned(hexFile)) {
+        if (!isBinaryImage && isByteAligned(hexFile)) {
             println(
               s"Hex file $hexFile is byte-aligned. Converting to word-aligned format."
             )
@@ -42,7 +45,7 @@ object RunHexDump extends App {
     println(s"Running simulation using hex file: $normalizedPath")
     println("Simulation started.")
 
-    val simRes = E2EUtils.runTestWithHex(normalizedPath)
+    val simRes = E2EUtils.runTestWithImage(normalizedPath)
 
     Thread.sleep(500) // Wait for final prints to flush
     if (!simRes.timedOut) {
@@ -0,0 +1,25 @@
+#include "include/extern.h"
+
+#define N 256
+
+int a[N];
+
+// Streaming loads with independent addresses, to measure D-cache hit
+// throughput
+int main() {
+    int i;
+    for (i = 0; i < N; i++) {
+        a[i] = 3 * i + 1;
+    }
+
+    int s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (i = 0; i < N; i += 4) {
+        s0 += a[i];
+        s1 += a[i + 1];
+        s2 += a[i + 2];
+        s3 += a[i + 3];
+    }
+
+    put(s0 + s1 + s2 + s3);
+    return 0;
+}
@@ -0,0 +1,205 @@
+package components.backend
+
+import chisel3._
+import chisel3.simulator.EphemeralSimulator._
+import org.scalatest.flatspec.AnyFlatSpec
+import org.scalatest.matchers.should.Matchers
+import scala.collection.mutable
+import common._
+
+class LoadStoreAdaptorTest extends AnyFlatSpec with Matchers {
+    val loadValue = BigInt(0x12345678)
+
+    case class MemReq(isLoad: Boolean, addr: BigInt, data: BigInt)
+
+    /** Drives the adaptor with a register file, a memory that answers every
+      * request the next cycle (loads return `loadValue`), and a CDB that takes
+      * every broadcast.
+      */
+    class Harness(dut: LoadStoreAdaptor) {
+        val pregs = mutable.Map[Int, BigInt]().withDefaultValue(BigInt(0))
+        val memReqs = mutable.ArrayBuffer[MemReq]()
+        val broadcasts = mutable.Map[Int, BigInt]() // robTag -> data
+        val resps = mutable.Queue[BigInt]() // Tags to answer
+
+        def init(): Unit = {
+            dut.io.issueIn.valid.poke(false.B)
+            dut.io.broadcastIn.valid.poke(false.B)
+            dut.io.flush.valid.poke(false.B)
+            dut.io.flush.flushTag.poke(0.U)
+            dut.io.flush.robHead.poke(0.U)
+            dut.io.robHead.poke(0.U)
+            dut.reset.poke(true.B)
+            cycle()
+            dut.reset.poke(false.B)
+        }
+
+        def cycle(): Unit = {
+            val a1 = dut.io.prfRead.addr1.peek().litValue.toInt
+            val a2 = dut.io.prfRead.addr2.peek().litValue.toInt
+            dut.io.prfRead.data1.poke(pregs(a1).U(32.W))
+            dut.io.prfRead.data2.poke(pregs(a2).U(32.W))
+            dut.io.broadcastOut.ready.poke(true.B)
+            dut.io.mem.req.ready.poke(true.B)
+            dut.io.mem.resp.valid.poke(resps.nonEmpty.B)
+            if (resps.nonEmpty) {
+                dut.io.mem.resp.bits.tag.poke(resps.head.U)
+                dut.io.mem.resp.bits.data.poke(loadValue.U(32.W))
+            }
+
+            val req = dut.io.mem.req
+            val reqFire = req.valid.peek().litToBoolean
+            val reqTag = req.bits.tag.peek().litValue
+            val memReq = MemReq(
+              req.bits.isLoad.peek().litToBoolean,
+              req.bits.addr.peek().litValue,
+              req.bits.data.peek().litValue
+            )
+            val bc = dut.io.broadcastOut
+            val bcFire = bc.valid.peek().litToBoolean
+            val bcTag = bc.bits.robTag.peek().litValue.toInt
+            val bcData = bc.bits.data.peek().litValue
+
+            dut.clock.step()
+
+            if (resps.nonEmpty) resps.dequeue()
+            if (reqFire) {
+                memReqs += memReq
+                resps.enqueue(reqTag)
+            }
+            if (bcFire) broadcasts(bcTag) = bcData
+        }
+
+        def run(n: Int): Unit = for (_ <- 0 until n) cycle()
+
+        def dispatch(
+            robTag: Int,
+            isStore: Boolean,
+            base: Int,
+            imm: Int = 0,
+            width: MemOpWidth.Type = MemOpWidth.WORD,
+            isUnsigned: Boolean = false,
+            data: Int = 0,
+            dataReady: Boolean = true,
+            pdst: Int = 0
+        ): Unit = {
+            val e = dut.io.issueIn.bits
+            e.robTag.poke(robTag.U)
+            e.pdst.poke(pdst.U)
+            e.src1.poke(base.U)
+            e.src1Ready.poke(true.B)
+            e.src2.poke(data.U)
+            e.src2Ready.poke(dataReady.B)
+            e.info.opWidth.poke(width)
+            e.info.isStore.poke(isStore.B)
+            e.info.isUnsigned.poke(isUnsigned.B)
+            e.info.imm.poke(imm.U)
+            e.pc.foreach(_.poke(0.U))
+            dut.io.issueIn.valid.poke(true.B)
+            var accepted = false
+            while (!accepted) {
+                accepted = dut.io.issueIn.ready.peek().litToBoolean
+                cycle()
+            }
+            dut.io.issueIn.valid.poke(false.B)
+        }
+    }
+
+    "LoadStoreAdaptor" should "forward a load from the youngest older store" in {
+        simulate(new LoadStoreAdaptor) { dut =>
+            val h = new Harness(dut)
+            h.init()
+            h.pregs(1) = 0x200
+            h.pregs(2) = 0x11223344
+            h.pregs(3) = 0x55667788
+
+            h.dispatch(1, isStore = true, base = 1, data = 2)
+            h.dispatch(2, isStore = true, base = 1, data = 3)
+            h.dispatch(
+              3,
+              isStore = false,
+              base = 1,
+              imm = 2,
+              width = MemOpWidth.HALFWORD,
+              isUnsigned = true,
+              pdst = 10
+            )
+            h.run(20)
+
+            // Neither store is committed, so nothing went to memory
+            h.memReqs shouldBe empty
+            h.broadcasts.keySet shouldBe Set(1, 2, 3)
+            h.broadcasts(3) shouldBe BigInt(0x5566)
+        }
+    }
+
+    it should "replay a load that older stores only partly cover" in {
+        simulate(new LoadStoreAdaptor) { dut =>
+            val h = new Harness(dut)
+            h.init()
+            h.pregs(1) = 0x100
+            h.pregs(2) = 0x0000ab00
+
+            h.dispatch(
+              1,
+              isStore = true,
+              base = 1,
+              imm = 1,
+              data = 2,
+              width = MemOpWidth.BYTE
+            )
+            h.dispatch(2, isStore = false, base = 1, pdst = 10)
+            h.run(20)
+
+            // The load keeps replaying while the store waits for commit
+            h.broadcasts.keySet shouldBe Set(1)
+            h.memReqs shouldBe empty
+
+            // Once the store drains, the load reads memory
+            dut.io.robHead.poke(1.U)
+            h.run(20)
+            h.memReqs.map(r => (r.isLoad, r.addr)) shouldBe Seq(
+              (false, BigInt(0x101)),
+              (true, BigInt(0x100))
+            )
+            h.broadcasts(2) shouldBe loadValue
+        }
+    }
+
+    it should "not hold younger loads behind a store waiting for its data" in {
+        simulate(new LoadStoreAdaptor) { dut =>
+            val h = new Harness(dut)
+            h.init()
+            h.pregs(1) = 0x100
+            h.pregs(6) = 0x300
+
+            // The store's data register (p5) is not ready yet
+            h.dispatch(1, isStore = true, base = 1, data = 5, dataReady = false)
+            h.dispatch(2, isStore = false, base = 6, pdst = 10)
+            h.dispatch(3, isStore = false, base = 1, pdst = 11)
+            h.run(20)
+
+            // The unrelated load went to memory; the other one needs the data
+            h.broadcasts.keySet shouldBe Set(1, 2)
+            h.memReqs.map(r => (r.isLoad, r.addr)) shouldBe Seq(
+              (true, BigInt(0x300))
+            )
+
+            // The data arrives on the CDB and is forwarded
+            dut.io.broadcastIn.valid.poke(true.B)
+            dut.io.broadcastIn.bits.pdst.poke(5.U)
+            dut.io.broadcastIn.bits.robTag.poke(0.U)
+            dut.io.broadcastIn.bits.data.poke(0xcafef00dL.U)
+            dut.io.broadcastIn.bits.writeEn.poke(true.B)
+            h.cycle()
+            dut.io.broadcastIn.valid.poke(false.B)
+            h.run(20)
+            h.broadcasts(3) shouldBe BigInt(0xcafef00dL)
+
+            // And the store drains with it once committed
+            dut.io.robHead.poke(1.U)
+            h.run(20)
+            h.memReqs.last shouldBe MemReq(false, 0x100, 0xcafef00dL)
+        }
+    }
+}
@@ -0,0 +1,179 @@
+package components.frontend
+
+import chisel3._
+import chisel3.simulator.EphemeralSimulator._
+import org.scalatest.flatspec.AnyFlatSpec
+import org.scalatest.matchers.should.Matchers
+
+class BranchTargetBufferTest extends AnyFlatSpec with Matchers {
+    def resetDut(dut: BranchTargetBuffer): Unit = {
+        dut.io.pc.poke(0.U)
+        dut.io.update.valid.poke(false.B)
+        dut.io.fill.valid.poke(false.B)
+        dut.reset.poke(true.B)
+        dut.clock.step()
+        dut.reset.poke(false.B)
+    }
+
+    // Target of every slot of the packet at `pc` (None on a miss) and whether
+    // it is a conditional branch, read the cycle after the lookup
+    def lookup(
+        dut: BranchTargetBuffer,
+        pc: Int
+    ): Seq[(Option[BigInt], Boolean)] = {
+        dut.io.pc.poke(pc.U)
+        dut.clock.step()
+        dut.io.target.zip(dut.io.isCond).map { case (t, c) =>
+            val hit = t.valid.peek().litToBoolean
+            (
+              if (hit) Some(t.bits.peek().litValue) else None,
+              c.peek().litToBoolean
+            )
+        }
+    }
+
+    def targets(dut: BranchTargetBuffer, pc: Int): Seq[Option[BigInt]] =
+        lookup(dut, pc).map(_._1)
+
+    def pokeUpdate(
+        dut: BranchTargetBuffer,
+        pc: Int,
+        target: Int,
+        taken: Boolean = true,
+        isCond: Boolean = true
+    ): Unit = {
+        dut.io.update.valid.poke(true.B)
+        dut.io.update.bits.pc.poke(pc.U)
+        dut.io.update.bits.target.poke(target.U)
+        dut.io.update.bits.taken.poke(taken.B)
+        dut.io.update.bits.isCond.poke(isCond.B)
+        dut.io.update.bits.mispredict.poke(true.B)
+    }
+
+    def pokeFill(dut: BranchTargetBuffer, pc: Int, target: Int): Unit = {
+        dut.io.fill.valid.poke(true.B)
+        dut.io.fill.bits.pc.poke(pc.U)
+        dut.io.fill.bits.target.poke(target.U)
+    }
+
+    def step(dut: BranchTargetBuffer): Unit = {
+        dut.clock.step()
+        dut.io.update.valid.poke(false.B)
+        dut.io.fill.valid.poke(false.B)
+    }
+
+    "BranchTargetBuffer" should "hit on a taken branch after its update" in {
+        simulate(new BranchTargetBuffer(BTBConfig())) { dut =>
+            resetDut(dut)
+
+            targets(dut, 0x100) shouldBe Seq.fill(4)(None)
+
+            // Slot 2 of the packet at 0x100
+            pokeUpdate(dut, 0x108, 0x2000)
+            step(dut)
+
+            val packet = lookup(dut, 0x100)
+            packet.map(_._1) shouldBe Seq(None, None, Some(0x2000), None)
+            packet(2)._2 shouldBe true
+            // Any address in the packet reads the whole packet
+            targets(dut, 0x10c)(2) shouldBe Some(0x2000)
+
+            // A later update of the same branch reuses its entry
+            pokeUpdate(dut, 0x108, 0x3000)
+            step(dut)
+            targets(dut, 0x100)(2) shouldBe Some(0x3000)
+        }
+    }
+
+    it should "miss on another tag or set" in {
+        simulate(new BranchTargetBuffer(BTBConfig())) { dut =>
+            resetDut(dut)
+
+            pokeUpdate(dut, 0x108, 0x2000)
+            step(dut)
+
+            // Same set, tag 2 instead of 1
+            targets(dut, 0x208) shouldBe Seq.fill(4)(None)
+            // Set 1
+            targets(dut, 0x118) shouldBe Seq.fill(4)(None)
+        }
+    }
+
+    it should "alias addresses whose folded partial tags match" in {
+        simulate(new BranchTargetBuffer(BTBConfig())) { dut =>
+            resetDut(dut)
+
+            pokeUpdate(dut, 0x108, 0x2000)
+            step(dut)
+
+            // Address bits 31:8 are 0x400: the 10-bit chunks 0x000 and 0x001
+            // fold to tag 1, the tag of 0x108
+            targets(dut, 0x40008)(2) shouldBe Some(0x2000)
+            // 0x401 folds to 0
+            targets(dut, 0x40108)(2) shouldBe None
+        }
+    }
+
+    it should "not install not-taken branches" in {
+        simulate(new BranchTargetBuffer(BTBConfig())) { dut =>
+            resetDut(dut)
+
+            pokeUpdate(dut, 0x30c, 0x2000, taken = false)
+            step(dut)
+
+            targets(dut, 0x300) shouldBe Seq.fill(4)(None)
+        }
+    }
+
+    it should "install direct jumps from decode as unconditional" in {
+        simulate(new BranchTargetBuffer(BTBConfig())) { dut =>
+            resetDut(dut)
+
+            pokeFill(dut, 0x204, 0x3000)
+            step(dut)
+
+            val packet = lookup(dut, 0x200)
+            packet.map(_._1) shouldBe Seq(None, Some(0x3000), None, None)
+            packet(1)._2 shouldBe false
+        }
+    }
+
+    it should "prefer an update over a fill in the same cycle" in {
+        simulate(new BranchTargetBuffer(BTBConfig())) { dut =>
+            resetDut(dut)
+
+            pokeUpdate(dut, 0x400, 0x1000)
+            pokeFill(dut, 0x504, 0x2000)
+            step(dut)
+
+            targets(dut, 0x400)(0) shouldBe Some(0x1000)
+            targets(dut, 0x500)(1) shouldBe None
+
+            // A not-taken update leaves the cycle to the fill
+            pokeUpdate(dut, 0x600, 0x1000, taken = false)
+            pokeFill(dut, 0x504, 0x2000)
+            step(dut)
+
+            targets(dut, 0x600)(0) shouldBe None
+            targets(dut, 0x500)(1) shouldBe Some(0x2000)
+        }
+    }
+
+    it should "keep nWays branches per slot of a set" in {
+        simulate(new BranchTargetBuffer(BTBConfig())) { dut =>
+            resetDut(dut)
+
+            // Five jumps in slot 0 of set 0, tags 1 to 5
+            val pcs = (1 to 5).map(_ << 8)
+            for ((pc, i) <- pcs.zipWithIndex) {
+                pokeFill(dut, pc, 0x1000 + i * 4)
+                step(dut)
+            }
+
+            val hits = pcs.map(pc => targets(dut, pc)(0))
+            hits.count(_.isDefined) shouldBe 4
+            // The last one was placed in the replacement victim
+            hits.last shouldBe Some(0x1010)
+        }
+    }
+}
@@ -0,0 +1,96 @@
+package components.frontend
+
+import chisel3._
+import chisel3.simulator.EphemeralSimulator._
+import org.scalatest.flatspec.AnyFlatSpec
+import org.scalatest.matchers.should.Matchers
+
+class GsharePredictorTest extends AnyFlatSpec with Matchers {
+    def resetDut(dut: GsharePredictor): Unit = {
+        dut.io.pc.poke(0.U)
+        dut.io.ghist.poke(0.U)
+        dut.io.update.valid.poke(false.B)
+        dut.reset.poke(true.B)
+        dut.clock.step()
+        dut.reset.poke(false.B)
+    }
+
+    // Counters of the packet at `pc`, read the cycle after the lookup
+    def lookup(dut: GsharePredictor, pc: Int, ghist: Int): Seq[BigInt] = {
+        dut.io.pc.poke(pc.U)
+        dut.io.ghist.poke(ghist.U)
+        dut.clock.step()
+        dut.io.counters.map(_.peek().litValue)
+    }
+
+    def update(
+        dut: GsharePredictor,
+        pc: Int,
+        ghist: Int,
+        counter: Int,
+        taken: Boolean
+    ): Unit = {
+        dut.io.update.valid.poke(true.B)
+        dut.io.update.bits.pc.poke(pc.U)
+        dut.io.update.bits.meta.ghist.poke(ghist.U)
+        dut.io.update.bits.meta.counter.poke(counter.U)
+        dut.io.update.bits.taken.poke(taken.B)
+        dut.clock.step()
+        dut.io.update.valid.poke(false.B)
+    }
+
+    "GsharePredictor" should "start weakly not taken" in {
+        simulate(new GsharePredictor) { dut =>
+            resetDut(dut)
+
+            lookup(dut, 0x100, 0) shouldBe Seq(1, 1, 1, 1)
+            lookup(dut, 0x1230, 0x2a5) shouldBe Seq(1, 1, 1, 1)
+        }
+    }
+
+    it should "train the slot from the counter it predicted with" in {
+        simulate(new GsharePredictor) { dut =>
+            resetDut(dut)
+
+            // Slot 1 of the packet at 0x100
+            update(dut, 0x104, 0x15, counter = 1, taken = true)
+            lookup(dut, 0x100, 0x15) shouldBe Seq(1, 2, 1, 1)
+
+            update(dut, 0x104, 0x15, counter = 2, taken = true)
+            lookup(dut, 0x100, 0x15)(1) shouldBe 3
+
+            // Saturates at both ends
+            update(dut, 0x104, 0x15, counter = 3, taken = true)
+            lookup(dut, 0x100, 0x15)(1) shouldBe 3
+            update(dut, 0x104, 0x15, counter = 3, taken = false)
+            lookup(dut, 0x100, 0x15)(1) shouldBe 2
+            update(dut, 0x104, 0x15, counter = 0, taken = false)
+            lookup(dut, 0x100, 0x15)(1) shouldBe 0
+        }
+    }
+
+    it should "leave the other slots of a written row alone" in {
+        simulate(new GsharePredictor) { dut =>
+            resetDut(dut)
+
+            update(dut, 0x108, 0, counter = 1, taken = true)
+            update(dut, 0x10c, 0, counter = 1, taken = false)
+            lookup(dut, 0x100, 0) shouldBe Seq(1, 1, 2, 0)
+        }
+    }
+
+    it should "index rows with the address XOR the history" in {
+        simulate(new GsharePredictor) { dut =>
+            resetDut(dut)
+
+            // Packet 1 with history 0 is row 1
+            update(dut, 0x10, 0, counter = 2, taken = true)
+            lookup(dut, 0x10, 0)(0) shouldBe 3
+
+            // Same packet, other history: another row
+            lookup(dut, 0x10, 1)(0) shouldBe 1
+            // Packet 0 with history 1 is row 1 as well
+            lookup(dut, 0x0, 1)(0) shouldBe 3
+        }
+    }
+}
@@ -0,0 +1,96 @@
+package components.memory
+
+import chisel3._
+import chisel3.simulator.EphemeralSimulator._
+import org.scalatest.flatspec.AnyFlatSpec
+import org.scalatest.matchers.should.Matchers
+
+class CacheReplacementTest extends AnyFlatSpec with Matchers {
+    def init(dut: CacheReplacement): Unit = {
+        dut.io.touch.valid.poke(false.B)
+        dut.io.set.poke(0.U)
+        dut.reset.poke(true.B)
+        dut.clock.step()
+        dut.reset.poke(false.B)
+    }
+
+    def touch(dut: CacheReplacement, set: Int, way: Int): Unit = {
+        dut.io.touch.valid.poke(true.B)
+        dut.io.touch.bits.set.poke(set.U)
+        dut.io.touch.bits.way.poke(way.U)
+        dut.clock.step()
+        dut.io.touch.valid.poke(false.B)
+    }
+
+    def victim(dut: CacheReplacement, set: Int): Int = {
+        dut.io.set.poke(set.U)
+        dut.io.victim.peek().litValue.toInt
+    }
+
+    "CacheReplacement" should "evict the least recently used way with LRU" in {
+        simulate(new CacheReplacement(2, 4, ReplacementPolicy.LRU)) { dut =>
+            init(dut)
+            victim(dut, 0) shouldBe 3
+
+            for (w <- Seq(3, 1, 0, 2)) touch(dut, 0, w)
+            victim(dut, 0) shouldBe 3
+            touch(dut, 0, 3)
+            victim(dut, 0) shouldBe 1
+            // Touching a recent way does not change the oldest one
+            touch(dut, 0, 3)
+            touch(dut, 0, 2)
+            victim(dut, 0) shouldBe 1
+
+            // Sets are independent
+            victim(dut, 1) shouldBe 3
+        }
+    }
+
+    it should "follow the tree with PLRU" in {
+        simulate(new CacheReplacement(2, 4, ReplacementPolicy.PLRU)) { dut =>
+            init(dut)
+            victim(dut, 0) shouldBe 0
+
+            // Each touch points the tree away from the touched way
+            for ((w, expected) <- Seq(0 -> 2, 2 -> 1, 1 -> 3, 3 -> 0)) {
+                touch(dut, 0, w)
+                victim(dut, 0) shouldBe expected
+            }
+            victim(dut, 1) shouldBe 0
+        }
+    }
+
+    it should "never pick the last touched way with PLRU" in {
+        simulate(new CacheReplacement(1 << 2, 8, ReplacementPolicy.PLRU)) {
+            dut =>
+                init(dut)
+                val rnd = new scala.util.Random(1)
+                for (_ <- 0 until 100) {
+                    val set = rnd.nextInt(4)
+                    val way = rnd.nextInt(8)
+                    touch(dut, set, way)
+                    victim(dut, set) should not be way
+                }
+        }
+    }
+
+    it should "spread random victims over all ways" in {
+        simulate(new CacheReplacement(2, 4, ReplacementPolicy.Random)) { dut =>
+            init(dut)
+            val seen = for (_ <- 0 until 64) yield {
+                val v = victim(dut, 0)
+                dut.clock.step()
+                v
+            }
+            seen.toSet shouldBe Set(0, 1, 2, 3)
+        }
+    }
+
+    it should "always evict way 0 of a direct-mapped cache" in {
+        simulate(new CacheReplacement(2, 1, ReplacementPolicy.LRU)) { dut =>
+            init(dut)
+            touch(dut, 0, 0)
+            victim(dut, 0) shouldBe 0
+        }
+    }
+}
@@ -0,0 +1,186 @@
+package components.memory
+
+import chisel3._
+import chisel3.simulator.EphemeralSimulator._
+import org.scalatest.flatspec.AnyFlatSpec
+import org.scalatest.matchers.should.Matchers
+import scala.collection.mutable
+
+class L2CacheTest extends AnyFlatSpec with Matchers {
+    val memConf = MemConfig(idWidth = 4, addrWidth = 32, dataWidth = 128)
+    // 4 sets x 2 ways, 16-byte lines: lines 0x40 apart share a set
+    val conf = CacheConfig(nSetsWidth = 2, nCacheLineWidth = 4, nWays = 2)
+    val fullMask = 0xffff
+
+    /** Drives the L2 against a DRAM that answers every request one cycle
+      * after accepting it, and counts what reaches DRAM.
+      */
+    class Harness(dut: L2Cache) {
+        val mem = mutable.Map[BigInt, BigInt]().withDefaultValue(BigInt(0))
+        val resps = mutable.Queue[(BigInt, BigInt)]()
+        var reads = 0
+        var writes = 0
+        var hits = 0
+        var misses = 0
+        var evictions = 0
+
+        def cycle(): Unit = {
+            dut.io.dram.req.ready.poke(true.B)
+            dut.io.dram.resp.valid.poke(resps.nonEmpty.B)
+            if (resps.nonEmpty) {
+                dut.io.dram.resp.bits.id.poke(resps.head._1.U)
+                dut.io.dram.resp.bits.data.poke(resps.head._2.U)
+            }
+            val respFire =
+                resps.nonEmpty && dut.io.dram.resp.ready.peek().litToBoolean
+            val reqFire = dut.io.dram.req.valid.peek().litToBoolean
+            val id = dut.io.dram.req.bits.id.peek().litValue
+            val addr = dut.io.dram.req.bits.addr.peek().litValue
+            val isWr = dut.io.dram.req.bits.isWr.peek().litToBoolean
+            val data = dut.io.dram.req.bits.data.peek().litValue
+            if (dut.io.events.hit.peek().litToBoolean) hits += 1
+            if (dut.io.events.miss.peek().litToBoolean) misses += 1
+            if (dut.io.events.eviction.peek().litToBoolean) evictions += 1
+
+            dut.clock.step()
+
+            if (respFire) resps.dequeue()
+            if (reqFire) {
+                if (isWr) {
+                    writes += 1
+                    mem(addr) = data
+                    resps.enqueue((id, BigInt(0)))
+                } else {
+                    reads += 1
+                    resps.enqueue((id, mem(addr)))
+                }
+            }
+        }
+
+        def reset(): Unit = {
+            dut.io.upstream.req.valid.poke(false.B)
+            dut.io.upstream.resp.ready.poke(false.B)
+            dut.io.flush.req.poke(false.B)
+            dut.reset.poke(true.B)
+            cycle()
+            dut.reset.poke(false.B)
+        }
+
+        // One upstream request, returns the response data
+        def access(
+            addr: Int,
+            isWr: Boolean = false,
+            data: BigInt = 0,
+            mask: Int = fullMask,
+            id: Int = 5
+        ): BigInt = {
+            dut.io.upstream.req.valid.poke(true.B)
+            dut.io.upstream.req.bits.id.poke(id.U)
+            dut.io.upstream.req.bits.addr.poke(addr.U)
+            dut.io.upstream.req.bits.isWr.poke(isWr.B)
+            dut.io.upstream.req.bits.data.poke(data.U(128.W))
+            dut.io.upstream.req.bits.mask.poke(mask.U)
+            var accepted = false
+            var timeout = 0
+            while (!accepted) {
+                accepted = dut.io.upstream.req.ready.peek().litToBoolean
+                cycle()
+                timeout += 1
+                require(timeout < 100, "L2 never accepted the request")
+            }
+            dut.io.upstream.req.valid.poke(false.B)
+
+            dut.io.upstream.resp.ready.poke(true.B)
+            while (!dut.io.upstream.resp.valid.peek().litToBoolean) {
+                cycle()
+                timeout += 1
+                require(timeout < 100, "L2 never answered the request")
+            }
+            dut.io.upstream.resp.bits.id.expect(id.U)
+            val result = dut.io.upstream.resp.bits.data.peek().litValue
+            cycle()
+            dut.io.upstream.resp.ready.poke(false.B)
+            result
+        }
+    }
+
+    def line(words: Int*): BigInt =
+        words.zipWithIndex
+            .map { case (w, i) => BigInt(w & 0xffffffffL) << (32 * i) }
+            .sum
+
+    "L2Cache" should "refill a missing line from DRAM and hit on it afterwards" in {
+        simulate(new L2Cache(conf, memConf)) { dut =>
+            val h = new Harness(dut)
+            h.reset()
+            val data = line(0x11111111, 0x22222222, 0x33333333, 0x44444444)
+            h.mem(BigInt(0x100)) = data
+
+            h.access(0x104) shouldBe data
+            h.misses shouldBe 1
+            h.reads shouldBe 1
+
+            h.access(0x10c) shouldBe data
+            h.hits shouldBe 1
+            h.reads shouldBe 1
+        }
+    }
+
+    it should "write back a dirty victim before reusing its way" in {
+        simulate(new L2Cache(conf, memConf)) { dut =>
+            val h = new Harness(dut)
+            h.reset()
+            val dirty = line(1, 2, 3, 4)
+
+            // A whole-line write is allocated without reading DRAM
+            h.access(0x000, isWr = true, data = dirty)
+            h.reads shouldBe 0
+            h.writes shouldBe 0
+
+            // Two more lines of the same set evict it
+            h.access(0x040)
+            h.access(0x080)
+            h.evictions shouldBe 1
+            h.writes shouldBe 1
+            h.mem(BigInt(0x000)) shouldBe dirty
+
+            // It comes back from DRAM with the written data
+            h.access(0x000) shouldBe dirty
+        }
+    }
+
+    it should "merge partial writes and flush dirty lines to DRAM" in {
+        simulate(new L2Cache(conf, memConf)) { dut =>
+            val h = new Harness(dut)
+            h.reset()
+            h.mem(BigInt(0x200)) = line(0xa, 0xb, 0xc, 0xd)
+            h.mem(BigInt(0x210)) = line(0xe, 0xf, 0x10, 0x11)
+
+            // Word 1 of the first line, word 3 of the second
+            h.access(0x200, isWr = true, data = line(0, 0x1234), mask = 0x00f0)
+            h.access(0x210, isWr = true, data = line(0, 0, 0, 0x5678), mask = 0xf000)
+            h.writes shouldBe 0
+
+            dut.io.flush.req.poke(true.B)
+            var timeout = 0
+            while (!dut.io.flush.done.peek().litToBoolean) {
+                h.cycle()
+                timeout += 1
+                require(timeout < 200, "flush never finished")
+            }
+            dut.io.flush.req.poke(false.B)
+
+            h.writes shouldBe 2
+            h.mem(BigInt(0x200)) shouldBe line(0xa, 0x1234, 0xc, 0xd)
+            h.mem(BigInt(0x210)) shouldBe line(0xe, 0xf, 0x10, 0x5678)
+
+            // Lines stay valid and clean: hits, no more writebacks
+            h.access(0x200) shouldBe line(0xa, 0x1234, 0xc, 0xd)
+            h.hits shouldBe 1
+            h.access(0x044)
+            h.access(0x084)
+            h.access(0x104)
+            h.writes shouldBe 2
+        }
+    }
+}
@@ -0,0 +1,169 @@
+package components.memory
+
+import chisel3._
+import chisel3.simulator.EphemeralSimulator._
+import org.scalatest.flatspec.AnyFlatSpec
+import org.scalatest.matchers.should.Matchers
+
+class MemInterconnectTest extends AnyFlatSpec with Matchers {
+    val conf = MemConfig(idWidth = 4, addrWidth = 32, dataWidth = 32)
+    // Master ID ranges on the memory side: [0, 2), [2, 5), [5, 9)
+    val nIds = Seq(2, 3, 4)
+
+    def init(dut: MemInterconnect): Unit = {
+        for (m <- dut.io.masters) {
+            m.req.valid.poke(false.B)
+            m.req.bits.id.poke(0.U)
+            m.req.bits.addr.poke(0.U)
+            m.req.bits.data.poke(0.U)
+            m.req.bits.isWr.poke(false.B)
+            m.req.bits.mask.poke(0.U)
+            m.resp.ready.poke(true.B)
+        }
+        dut.io.mem.req.ready.poke(true.B)
+        dut.io.mem.resp.valid.poke(false.B)
+        dut.reset.poke(true.B)
+        dut.clock.step()
+        dut.reset.poke(false.B)
+    }
+
+    def request(
+        dut: MemInterconnect,
+        master: Int,
+        id: Int,
+        isWr: Boolean = false
+    ): Unit = {
+        val r = dut.io.masters(master).req
+        r.valid.poke(true.B)
+        r.bits.id.poke(id.U)
+        r.bits.addr.poke((0x1000 * (master + 1)).U)
+        r.bits.isWr.poke(isWr.B)
+    }
+
+    // Master whose request the interconnect takes this cycle
+    def granted(dut: MemInterconnect): Int = {
+        val g = (0 until nIds.length).filter(i =>
+            dut.io.masters(i).req.ready.peek().litToBoolean
+        )
+        g.length shouldBe 1
+        g.head
+    }
+
+    "MemInterconnect" should "translate IDs into each master's range and back" in {
+        simulate(new MemInterconnect(conf, nIds)) { dut =>
+            init(dut)
+
+            request(dut, 1, 2)
+            dut.io.mem.req.valid.expect(true.B)
+            dut.io.mem.req.bits.id.expect(4.U)
+            dut.io.mem.req.bits.addr.expect(0x2000.U)
+            dut.clock.step()
+            dut.io.masters(1).req.valid.poke(false.B)
+
+            request(dut, 2, 3)
+            dut.io.mem.req.bits.id.expect(8.U)
+            dut.clock.step()
+            dut.io.masters(2).req.valid.poke(false.B)
+
+            // Responses go to the owner of the ID, with the master's own ID
+            for ((memId, master, id) <- Seq((4, 1, 2), (6, 2, 1), (1, 0, 1))) {
+                dut.io.mem.resp.valid.poke(true.B)
+                dut.io.mem.resp.bits.id.poke(memId.U)
+                dut.io.mem.resp.bits.data.poke((0x100 + memId).U)
+                dut.io.mem.resp.ready.expect(true.B)
+                for (i <- 0 until nIds.length) {
+                    dut.io.masters(i).resp.valid.expect((i == master).B)
+                }
+                dut.io.masters(master).resp.bits.id.expect(id.U)
+                dut.io.masters(master).resp.bits.data.expect((0x100 + memId).U)
+                dut.clock.step()
+            }
+            dut.io.mem.resp.valid.poke(false.B)
+        }
+    }
+
+    it should "queue responses for a master that is not ready" in {
+        simulate(new MemInterconnect(conf, nIds, respDepth = 2)) { dut =>
+            init(dut)
+            dut.io.masters(0).resp.ready.poke(false.B)
+
+            // Two responses fit in master 0's queue, the third waits
+            dut.io.mem.resp.valid.poke(true.B)
+            for (id <- 0 until 2) {
+                dut.io.mem.resp.bits.id.poke(id.U)
+                dut.io.mem.resp.ready.expect(true.B)
+                dut.clock.step()
+            }
+            dut.io.mem.resp.bits.id.poke(0.U)
+            dut.io.mem.resp.ready.expect(false.B)
+
+            // Other masters are not held up
+            dut.io.mem.resp.bits.id.poke(3.U)
+            dut.io.mem.resp.ready.expect(true.B)
+            dut.io.masters(1).resp.valid.expect(true.B)
+            dut.clock.step()
+            dut.io.mem.resp.valid.poke(false.B)
+
+            // Master 0 gets its responses in order
+            dut.io.masters(0).resp.ready.poke(true.B)
+            dut.io.masters(0).resp.valid.expect(true.B)
+            dut.io.masters(0).resp.bits.id.expect(0.U)
+            dut.clock.step()
+            dut.io.masters(0).resp.bits.id.expect(1.U)
+            dut.clock.step()
+            dut.io.masters(0).resp.valid.expect(false.B)
+        }
+    }
+
+    it should "pick the lowest master with the fixed policy" in {
+        simulate(new MemInterconnect(conf, nIds, ArbiterPolicy.Fixed)) { dut =>
+            init(dut)
+            request(dut, 2, 0)
+            request(dut, 1, 0, isWr = true)
+            granted(dut) shouldBe 1
+            request(dut, 0, 0, isWr = true)
+            granted(dut) shouldBe 0
+            dut.clock.step()
+            granted(dut) shouldBe 0
+        }
+    }
+
+    it should "put reads before writes with the reads-first policy" in {
+        simulate(new MemInterconnect(conf, nIds, ArbiterPolicy.ReadsFirst)) {
+            dut =>
+                init(dut)
+                request(dut, 0, 0, isWr = true)
+                request(dut, 1, 0, isWr = true)
+                request(dut, 2, 0)
+                granted(dut) shouldBe 2
+                dut.io.mem.req.bits.isWr.expect(false.B)
+
+                // Without reads, the lowest writer goes first
+                dut.io.masters(2).req.valid.poke(false.B)
+                granted(dut) shouldBe 0
+        }
+    }
+
+    it should "rotate between masters with the round-robin policy" in {
+        simulate(new MemInterconnect(conf, nIds, ArbiterPolicy.RoundRobin)) {
+            dut =>
+                init(dut)
+                for (i <- 0 until nIds.length) request(dut, i, 0)
+                val order = for (_ <- 0 until 6) yield {
+                    val g = granted(dut)
+                    dut.clock.step()
+                    g
+                }
+                order shouldBe Seq(1, 2, 0, 1, 2, 0)
+
+                // A master that stops requesting is skipped
+                dut.io.masters(1).req.valid.poke(false.B)
+                val order2 = for (_ <- 0 until 4) yield {
+                    val g = granted(dut)
+                    dut.clock.step()
+                    g
+                }
+                order2 shouldBe Seq(2, 0, 2, 0)
+        }
+    }
+}
@@ -0,0 +1,319 @@
+package components.structures
+
+import chisel3._
+import chisel3.simulator.EphemeralSimulator._
+import org.scalatest.flatspec.AnyFlatSpec
+import org.scalatest.matchers.should.Matchers
+import common._
+
+class LoadStoreQueueTest extends AnyFlatSpec with Matchers {
+    def pokeEntry(
+        e: SequentialBufferEntry[LoadStoreInfo],
+        robTag: Int,
+        isStore: Boolean,
+        width: MemOpWidth.Type = MemOpWidth.WORD,
+        src1Ready: Boolean = true,
+        src2Ready: Boolean = true
+    ): Unit = {
+        e.robTag.poke(robTag.U)
+        e.pdst.poke(0.U)
+        e.src1.poke(1.U)
+        e.src2.poke(2.U)
+        e.src1Ready.poke(src1Ready.B)
+        e.src2Ready.poke(src2Ready.B)
+        e.info.opWidth.poke(width)
+        e.info.isStore.poke(isStore.B)
+        e.info.isUnsigned.poke(false.B)
+        e.info.imm.poke(0.U)
+        e.pc.foreach(_.poke(0.U))
+    }
+
+    def initStq(dut: StoreQueue): Unit = {
+        dut.io.in.valid.poke(false.B)
+        dut.io.broadcast.valid.poke(false.B)
+        dut.io.flush.valid.poke(false.B)
+        dut.io.flush.flushTag.poke(0.U)
+        dut.io.flush.robHead.poke(0.U)
+        dut.io.robHead.poke(0.U)
+        dut.io.issue.ready.poke(false.B)
+        dut.io.resolve.valid.poke(false.B)
+        dut.io.drain.ready.poke(false.B)
+        dut.io.fwd.addr.poke(0.U)
+        dut.io.fwd.stqPtr.poke(0.U)
+        dut.io.fwd.info.opWidth.poke(MemOpWidth.WORD)
+        dut.io.fwd.info.isStore.poke(false.B)
+        dut.io.fwd.info.isUnsigned.poke(false.B)
+        dut.io.fwd.info.imm.poke(0.U)
+        dut.reset.poke(true.B)
+        dut.clock.step()
+        dut.reset.poke(false.B)
+    }
+
+    def enqStore(
+        dut: StoreQueue,
+        robTag: Int,
+        width: MemOpWidth.Type = MemOpWidth.WORD,
+        src2Ready: Boolean = true
+    ): Unit = {
+        pokeEntry(
+          dut.io.in.bits,
+          robTag,
+          isStore = true,
+          width = width,
+          src2Ready = src2Ready
+        )
+        dut.io.in.valid.poke(true.B)
+        dut.io.in.ready.expect(true.B)
+        dut.clock.step()
+        dut.io.in.valid.poke(false.B)
+    }
+
+    def resolve(dut: StoreQueue, ptr: Int, addr: Int, data: Long): Unit = {
+        dut.io.resolve.valid.poke(true.B)
+        dut.io.resolve.bits.ptr.poke(ptr.U)
+        dut.io.resolve.bits.addr.poke(addr.U)
+        dut.io.resolve.bits.data.poke(data.U(32.W))
+        dut.io.resolve.bits.dataValid.poke(true.B)
+        dut.clock.step()
+        dut.io.resolve.valid.poke(false.B)
+    }
+
+    "StoreQueue" should "forward each byte from the youngest older store" in {
+        simulate(new StoreQueue(8, 8)) { dut =>
+            initStq(dut)
+            enqStore(dut, 1)
+            enqStore(dut, 2)
+            enqStore(dut, 3, MemOpWidth.HALFWORD)
+            resolve(dut, 0, 0x100, 0x11111111L)
+            resolve(dut, 1, 0x100, 0x22222222L)
+            // Lanes 2 and 3, taken from the same lanes of the data
+            resolve(dut, 2, 0x102, 0xaaaa5555L)
+
+            dut.io.fwd.addr.poke(0x100.U)
+
+            // No older store
+            dut.io.fwd.stqPtr.poke(0.U)
+            dut.io.fwd.mask.expect(0.U)
+            dut.io.fwd.older.expect(false.B)
+
+            // Only the first store is older
+            dut.io.fwd.stqPtr.poke(1.U)
+            dut.io.fwd.mask.expect(0xf.U)
+            dut.io.fwd.data.expect(0x11111111L.U)
+            dut.io.fwd.older.expect(true.B)
+
+            // The second store overrides the first
+            dut.io.fwd.stqPtr.poke(2.U)
+            dut.io.fwd.mask.expect(0xf.U)
+            dut.io.fwd.data.expect(0x22222222L.U)
+
+            // The halfword store overrides the upper lanes only
+            dut.io.fwd.stqPtr.poke(3.U)
+            dut.io.fwd.mask.expect(0xf.U)
+            dut.io.fwd.data.expect(0xaaaa2222L.U)
+            dut.io.fwd.pending.expect(0.U)
+
+            // Other words are not matched
+            dut.io.fwd.addr.poke(0x104.U)
+            dut.io.fwd.mask.expect(0.U)
+        }
+    }
+
+    it should "report partial overlaps and stores without data" in {
+        simulate(new StoreQueue(8, 8)) { dut =>
+            initStq(dut)
+            enqStore(dut, 1, MemOpWidth.BYTE)
+            enqStore(dut, 2, src2Ready = false)
+            resolve(dut, 0, 0x101, 0x0000ab00L)
+
+            // A word load over a byte store sees one lane: the LSU replays it
+            dut.io.fwd.addr.poke(0x100.U)
+            dut.io.fwd.stqPtr.poke(1.U)
+            dut.io.fwd.mask.expect(0x2.U)
+            ((dut.io.fwd.data.peek().litValue >> 8) & 0xff) shouldBe 0xab
+
+            // The word store knows its address, but its data comes late
+            dut.io.resolve.valid.poke(true.B)
+            dut.io.resolve.bits.ptr.poke(1.U)
+            dut.io.resolve.bits.addr.poke(0x100.U)
+            dut.io.resolve.bits.data.poke(0.U)
+            dut.io.resolve.bits.dataValid.poke(false.B)
+            dut.clock.step()
+            dut.io.resolve.valid.poke(false.B)
+
+            dut.io.addrValid(1).expect(true.B)
+            dut.io.fwd.stqPtr.poke(2.U)
+            dut.io.fwd.mask.expect(0xf.U)
+            dut.io.fwd.pending.expect(0xf.U)
+
+            // The broadcast waking its data register supplies the data
+            dut.io.broadcast.valid.poke(true.B)
+            dut.io.broadcast.bits.pdst.poke(2.U)
+            dut.io.broadcast.bits.robTag.poke(0.U)
+            dut.io.broadcast.bits.data.poke(0xcafef00dL.U)
+            dut.io.broadcast.bits.writeEn.poke(true.B)
+            dut.clock.step()
+            dut.io.broadcast.valid.poke(false.B)
+
+            dut.io.fwd.pending.expect(0.U)
+            dut.io.fwd.data.expect(0xcafef00dL.U)
+        }
+    }
+
+    it should "issue stores in order once their base register is ready" in {
+        simulate(new StoreQueue(8, 8)) { dut =>
+            initStq(dut)
+            pokeEntry(dut.io.in.bits, 1, isStore = true, src2Ready = false)
+            dut.io.in.valid.poke(true.B)
+            dut.clock.step()
+            pokeEntry(dut.io.in.bits, 2, isStore = true, src1Ready = false)
+            dut.clock.step()
+            dut.io.in.valid.poke(false.B)
+
+            // The first store issues without its data
+            dut.io.issue.ready.poke(true.B)
+            dut.io.issue.valid.expect(true.B)
+            dut.io.issue.bits.stqPtr.expect(0.U)
+            dut.io.issue.bits.bits.robTag.expect(1.U)
+            dut.clock.step()
+
+            // The second waits for its base register
+            dut.io.issue.valid.expect(false.B)
+        }
+    }
+
+    it should "keep committed stores on a flush" in {
+        simulate(new StoreQueue(8, 8)) { dut =>
+            initStq(dut)
+            enqStore(dut, 1)
+            enqStore(dut, 4)
+            enqStore(dut, 5)
+            resolve(dut, 0, 0x100, 0x1L)
+
+            // Store 1 reaches the ROB head and commits
+            dut.io.robHead.poke(1.U)
+            dut.clock.step()
+            dut.io.robHead.poke(2.U)
+
+            // All three issue
+            dut.io.issue.ready.poke(true.B)
+            dut.clock.step(3)
+            dut.io.issue.ready.poke(false.B)
+
+            // A branch at tag 3 mispredicts. Store 1 has left the ROB, so the
+            // tag range alone would kill it too.
+            dut.io.flush.valid.poke(true.B)
+            dut.io.flush.flushTag.poke(3.U)
+            dut.io.flush.robHead.poke(2.U)
+            dut.clock.step()
+            dut.io.flush.valid.poke(false.B)
+
+            dut.io.count.expect(1.U)
+            dut.io.tail.expect(1.U)
+            dut.io.drain.valid.expect(true.B)
+            dut.io.drain.bits.bits.robTag.expect(1.U)
+            dut.io.drain.bits.addr.expect(0x100.U)
+
+            // The next store reuses the freed slots and issues from there
+            enqStore(dut, 4)
+            dut.io.issue.ready.poke(true.B)
+            dut.io.issue.valid.expect(true.B)
+            dut.io.issue.bits.stqPtr.expect(1.U)
+
+            dut.io.drain.ready.poke(true.B)
+            dut.clock.step()
+            dut.io.count.expect(1.U)
+        }
+    }
+
+    def initLdq(dut: LoadQueue): Unit = {
+        dut.io.in.valid.poke(false.B)
+        dut.io.broadcast.valid.poke(false.B)
+        dut.io.flush.valid.poke(false.B)
+        dut.io.flush.flushTag.poke(0.U)
+        dut.io.flush.robHead.poke(0.U)
+        dut.io.stqHead.poke(0.U)
+        dut.io.stqTail.poke(0.U)
+        for (i <- 0 until 8) dut.io.stqAddrValid(i).poke(false.B)
+        dut.io.out.ready.poke(false.B)
+        dut.io.replay.valid.poke(false.B)
+        dut.io.done.valid.poke(false.B)
+        dut.reset.poke(true.B)
+        dut.clock.step()
+        dut.reset.poke(false.B)
+    }
+
+    def enqLoad(dut: LoadQueue, robTag: Int): Unit = {
+        pokeEntry(dut.io.in.bits, robTag, isStore = false)
+        dut.io.in.valid.poke(true.B)
+        dut.clock.step()
+        dut.io.in.valid.poke(false.B)
+    }
+
+    "LoadQueue" should "hold a load until every older store address is known" in {
+        simulate(new LoadQueue(8, 8)) { dut =>
+            initLdq(dut)
+
+            // Slots 7 and 0 hold older stores: the pointers wrap
+            dut.io.stqHead.poke(7.U)
+            dut.io.stqTail.poke(9.U)
+            enqLoad(dut, 10)
+
+            dut.io.out.valid.expect(false.B)
+            dut.io.stqAddrValid(7).poke(true.B)
+            dut.io.out.valid.expect(false.B)
+            // Slot 1 is younger than the load
+            dut.io.stqAddrValid(1).poke(true.B)
+            dut.io.out.valid.expect(false.B)
+            dut.io.stqAddrValid(0).poke(true.B)
+            dut.io.out.valid.expect(true.B)
+            dut.io.out.bits.stqPtr.expect(9.U)
+            dut.io.out.bits.bits.robTag.expect(10.U)
+        }
+    }
+
+    it should "issue loads out of order and reissue replayed ones" in {
+        simulate(new LoadQueue(8, 8)) { dut =>
+            initLdq(dut)
+            // Load 10 waits for its base register (p1)
+            pokeEntry(dut.io.in.bits, 10, isStore = false, src1Ready = false)
+            dut.io.in.valid.poke(true.B)
+            dut.clock.step()
+            dut.io.in.valid.poke(false.B)
+            enqLoad(dut, 11)
+
+            // The younger load goes first
+            dut.io.out.ready.poke(true.B)
+            dut.io.out.valid.expect(true.B)
+            dut.io.out.bits.bits.robTag.expect(11.U)
+            dut.io.out.bits.ldqIdx.expect(1.U)
+            dut.clock.step()
+            dut.io.out.valid.expect(false.B)
+
+            // A replayed load issues again
+            dut.io.out.ready.poke(false.B)
+            dut.io.replay.valid.poke(true.B)
+            dut.io.replay.bits.poke(1.U)
+            dut.clock.step()
+            dut.io.replay.valid.poke(false.B)
+            dut.io.out.valid.expect(true.B)
+            dut.io.out.bits.bits.robTag.expect(11.U)
+
+            // Load 11 completes; load 10 wakes up and issues
+            dut.io.done.valid.poke(true.B)
+            dut.io.done.bits.poke(1.U)
+            dut.io.broadcast.valid.poke(true.B)
+            dut.io.broadcast.bits.pdst.poke(1.U)
+            dut.io.broadcast.bits.robTag.poke(0.U)
+            dut.io.broadcast.bits.data.poke(0.U)
+            dut.io.broadcast.bits.writeEn.poke(true.B)
+            dut.clock.step()
+            dut.io.done.valid.poke(false.B)
+            dut.io.broadcast.valid.poke(false.B)
+
+            dut.io.out.valid.expect(true.B)
+            dut.io.out.bits.bits.robTag.expect(10.U)
+            dut.io.count.expect(1.U)
+        }
+    }
+}